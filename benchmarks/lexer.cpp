@@ -1,18 +1,94 @@
 #include <benchmark/benchmark.h>
+#include <string>
 
 #define DOCTEST_CONFIG_IMPLEMENT
 #include "../src/doctest.h"
+#include "../src/document.h"
 #include "../src/lexer.h"
 #include "../src/parser.h"
+#include "../src/scan.h"
 
 const auto code = "int main(void) { return ~(-2); }";
 
 static void Lexer_generate_tokens(benchmark::State &state) {
-    std::stringstream source(code);
     for (auto _ : state) {
-        tokenize(source);
+        benchmark::DoNotOptimize(tokenize(code));
     }
 }
 BENCHMARK(Lexer_generate_tokens);
 
+// Roughly the shape of machine-generated sources: long identifiers, long
+// literals and wide indentation.
+static std::string large_source(std::size_t bytes) {
+    const std::string fn =
+        "int generated_function_with_a_long_name_0123456789(void) {\n"
+        "                                return "
+        "~(-(~(-1234567890123456789))); \n}\n";
+    std::string source{};
+    source.reserve(bytes + fn.size());
+    while (source.size() < bytes) {
+        source += fn;
+    }
+    return source;
+}
+
+static void Lexer_large_input(benchmark::State &state) {
+    auto previous = Scan::current_impl();
+    Scan::use_impl(Scan::Impl(state.range(0)));
+    auto source = large_source(8 << 20);
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(tokenize(source));
+    }
+    state.SetBytesProcessed(state.iterations() * source.size());
+    Scan::use_impl(previous);
+}
+BENCHMARK(Lexer_large_input)
+    ->ArgName("impl")
+    ->Arg(int(Scan::Impl::Scalar))
+    ->Arg(int(Scan::Impl::SSE2))
+    ->Arg(int(Scan::Impl::AVX2))
+    ->Unit(benchmark::kMillisecond);
+
+static void Lexer_parallel(benchmark::State &state) {
+    auto source = large_source(64 << 20);
+    auto threads = static_cast<unsigned>(state.range(0));
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(tokenize(source, threads));
+    }
+    state.SetBytesProcessed(state.iterations() * source.size());
+}
+BENCHMARK(Lexer_parallel)
+    ->ArgName("threads")
+    ->RangeMultiplier(2)
+    ->Range(1, 16)
+    ->UseRealTime()
+    ->Unit(benchmark::kMillisecond);
+
+// One keystroke in a large file, against lexing and parsing it again
+static void Document_edit(benchmark::State &state) {
+    Document document(large_source(state.range(0) << 10));
+    auto at = document.text().find("1234567890123456789");
+    for (auto _ : state) {
+        document.edit(at, 1, "2");
+        document.edit(at, 1, "1");
+    }
+    state.SetItemsProcessed(state.iterations() * 2);
+}
+BENCHMARK(Document_edit)->ArgName("KiB")->RangeMultiplier(8)->Range(8, 8192);
+
+static void Document_full_reparse(benchmark::State &state) {
+    auto source = large_source(state.range(0) << 10);
+    for (auto _ : state) {
+        Arena arena{};
+        auto tokens = tokenize(source);
+        Ast::Parser parser(tokens, arena);
+        benchmark::DoNotOptimize(parser.parse());
+    }
+}
+BENCHMARK(Document_full_reparse)
+    ->ArgName("KiB")
+    ->RangeMultiplier(8)
+    ->Range(8, 8192)
+    ->Unit(benchmark::kMillisecond);
+
 BENCHMARK_MAIN();
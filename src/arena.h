@@ -0,0 +1,100 @@
+#pragma once
+
+#include <cassert>
+#include <cstddef>
+#include <memory>
+#include <memory_resource>
+#include <span>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+// Bytes an Arena has handed out, and bytes it has taken from the heap to do
+// so. Both only grow.
+struct ArenaStats {
+    std::size_t used{};
+    std::size_t reserved{};
+};
+
+// Owns the memory of one compilation: nodes, token arrays and instruction
+// lists. Deallocation is a no-op, so storage stays valid until the arena
+// goes away and is then released in one go. Not thread-safe.
+class Arena : public std::pmr::memory_resource {
+    // Counts the chunks the monotonic resource requests
+    class Upstream : public std::pmr::memory_resource {
+        std::size_t _reserved{};
+
+        void *do_allocate(std::size_t bytes, std::size_t align) override {
+            _reserved += bytes;
+            return std::pmr::new_delete_resource()->allocate(bytes, align);
+        }
+        void do_deallocate(void *p, std::size_t bytes,
+                           std::size_t align) override {
+            std::pmr::new_delete_resource()->deallocate(p, bytes, align);
+        }
+        bool do_is_equal(const memory_resource &other) const noexcept override {
+            return this == &other;
+        }
+
+      public:
+        std::size_t reserved() const noexcept { return _reserved; }
+    };
+
+    Upstream _upstream{};
+    std::pmr::monotonic_buffer_resource _resource;
+    std::size_t _used{};
+
+    void *do_allocate(std::size_t bytes, std::size_t align) override {
+        _used += bytes;
+        return _resource.allocate(bytes, align);
+    }
+    void do_deallocate(void *, std::size_t, std::size_t) override {}
+    bool do_is_equal(const memory_resource &other) const noexcept override {
+        return this == &other;
+    }
+
+  public:
+    // The first chunk taken from the heap holds `initial_size` bytes; later
+    // ones grow geometrically
+    explicit Arena(std::size_t initial_size = 4096)
+        : _resource(initial_size, &_upstream) {
+        assert(initial_size > 0);
+    }
+    Arena(const Arena &) = delete;
+    Arena &operator=(const Arena &) = delete;
+
+    template <typename T, typename... Args> T *make(Args &&...args) {
+        static_assert(std::is_trivially_destructible_v<T>);
+        void *memory = allocate(sizeof(T), alignof(T));
+        return ::new (memory) T(std::forward<Args>(args)...);
+    }
+
+    // Copies `items` into the arena
+    template <typename T> std::span<const T> copy(std::span<const T> items) {
+        static_assert(std::is_trivially_copyable_v<T>);
+        if (items.empty()) {
+            return {};
+        }
+        auto *memory =
+            static_cast<T *>(allocate(items.size_bytes(), alignof(T)));
+        std::uninitialized_copy(items.begin(), items.end(), memory);
+        return {memory, items.size()};
+    }
+    template <typename T> std::span<const T> copy(const std::vector<T> &items) {
+        return copy(std::span<const T>(items));
+    }
+
+    // Takes over the storage of a vector allocated in this arena, leaving
+    // `items` empty, instead of copying it
+    template <typename T>
+    std::span<const T> adopt(std::pmr::vector<T> &items) {
+        static_assert(std::is_trivially_destructible_v<T>);
+        assert(items.get_allocator().resource() == this);
+        std::span<const T> kept(items);
+        std::pmr::vector<T>(this).swap(items);
+        return kept;
+    }
+
+    std::pmr::memory_resource *resource() { return this; }
+    ArenaStats stats() const { return {_used, _upstream.reserved()}; }
+};
@@ -1,318 +1,362 @@
-#include <algorithm>
-#include <array>
+#include <cstdlib>
 #include <format>
-#include <iostream>
-#include <iterator>
-#include <memory>
-#include <stdexcept>
+#include <vector>
 
 #include "../doctest.h"
 #include "assembly.h"
 
 namespace Asm {
-Program Generator::generate_assembly(Tacky::Program &tacky_ir) {
-    auto assembly = convert_tacky_to_assembly(tacky_ir);
-    assembly = replace_pseudo_registers(assembly);
-    return fixup_instructions(assembly);
+std::string to_string(const Operand &operand) {
+    switch (operand.kind()) {
+    case Operand::Kind::Imm:
+        return std::format("${}", operand.imm().value);
+    case Operand::Kind::Reg:
+        return operand.reg().reg == Reg::AX ? "%eax" : "%r10d";
+    case Operand::Kind::Pseudo:
+        return std::format("Pseudo({})", operand.pseudo().reg);
+    case Operand::Kind::Stack:
+        return std::format("{}(%rbp)", operand.stack().offset);
+    }
+    __builtin_unreachable();
 }
 
-Program Generator::convert_tacky_to_assembly(Tacky::Program &tacky_ir) {
-    Program program(parse_func_def(std::move(tacky_ir.fn())));
-    return program;
+std::string to_string(const Instruction &instr) {
+    switch (instr.kind()) {
+    case Instruction::Kind::Mov:
+        return std::format("movl {}, {}", to_string(instr.mov().src),
+                           to_string(instr.mov().dst));
+    case Instruction::Kind::Unary:
+        return std::format(
+            "{} {}", instr.unary().op == UnaryOperator::Not ? "notl" : "negl",
+            to_string(instr.unary().dst));
+    case Instruction::Kind::AllocateStack:
+        return std::format("subq ${}, %rsp", instr.allocate_stack().size);
+    case Instruction::Kind::Ret:
+        return "ret";
+    }
+    __builtin_unreachable();
 }
 
-FunctionDef Generator::parse_func_def(std::unique_ptr<Tacky::Function> fn) {
-    std::vector<std::unique_ptr<Instruction>> fn_instrs{};
-    for (auto &instr : fn->body()) {
-        auto instrs = parse_instruction(std::move(instr));
-        fn_instrs.insert(fn_instrs.end(),
-                         std::make_move_iterator(instrs.begin()),
-                         std::make_move_iterator(instrs.end()));
+Program Generator::generate_assembly(const Tacky::Program &tacky_ir) {
+    std::pmr::vector<FunctionDef> functions(&_arena);
+    functions.reserve(tacky_ir.functions.size());
+    for (const auto &fn : tacky_ir.functions) {
+        functions.push_back(generate_function(fn));
     }
-    return FunctionDef(fn->name(), std::move(fn_instrs));
+    return Program{_arena.adopt(functions)};
+}
+
+FunctionDef Generator::generate_function(const Tacky::Function &fn) {
+    _stack_offset = 0;
+    _slots.assign(fn.registers, 0);
+    auto fn_def = parse_func_def(fn);
+    fn_def = replace_pseudo_registers(fn_def);
+    return fixup_instructions(fn_def);
 }
 
-std::vector<std::unique_ptr<Instruction>>
-Generator::parse_instruction(std::unique_ptr<Tacky::Instruction> instr) {
-    std::vector<std::unique_ptr<Instruction>> asm_instrs{};
-
-    if (auto *return_instr = dynamic_cast<Tacky::Return *>(instr.get())) {
-        auto reg = std::make_unique<Reg>(std::make_unique<AX>());
-        asm_instrs.emplace_back(std::make_unique<Mov>(
-            parse_operand(return_instr->val()), std::move(reg)));
-        asm_instrs.emplace_back(std::make_unique<Ret>());
-    } else if (auto *unary_instr = dynamic_cast<Tacky::Unary *>(instr.get())) {
-        std::unique_ptr<Tacky::Val> unary_dst = unary_instr->dst();
-        std::unique_ptr<Tacky::Val> unary_src = unary_instr->src();
-
-        auto mov = std::make_unique<Mov>(parse_operand(unary_src),
-                                         parse_operand(unary_dst));
-        asm_instrs.emplace_back(std::move(mov));
-        auto unary = std::make_unique<Unary>(parse_unop(unary_instr->op()),
-                                             parse_operand(unary_dst));
-        asm_instrs.emplace_back(std::move(unary));
-    } else {
-        throw std::runtime_error("Unknown Instruction");
+Program Generator::convert_tacky_to_assembly(const Tacky::Program &tacky_ir) {
+    std::pmr::vector<FunctionDef> functions(&_arena);
+    functions.reserve(tacky_ir.functions.size());
+    for (const auto &fn : tacky_ir.functions) {
+        functions.push_back(parse_func_def(fn));
     }
+    return Program{_arena.adopt(functions)};
+}
 
-    return asm_instrs;
+FunctionDef Generator::parse_func_def(const Tacky::Function &fn) {
+    std::pmr::vector<Instruction> fn_instrs(&_arena);
+    fn_instrs.reserve(fn.body.size() * 2);
+    for (const auto &instr : fn.body) {
+        parse_instruction(fn, instr, fn_instrs);
+    }
+    return FunctionDef{fn.name, _arena.adopt(fn_instrs)};
 }
 
-std::unique_ptr<Operand>
-Generator::parse_operand(std::unique_ptr<Tacky::Val> &operand) {
-    if (auto *constant = dynamic_cast<Tacky::Constant *>(operand.get())) {
-        return std::make_unique<Imm>(constant->value());
-    } else if (auto *var = dynamic_cast<Tacky::Var *>(operand.get())) {
-        return std::make_unique<Pseudo>(var->value());
-    } else {
-        throw std::runtime_error("Unknown Operand");
+void Generator::parse_instruction(const Tacky::Function &fn,
+                                  const Tacky::Instruction &instr,
+                                  std::pmr::vector<Instruction> &out) {
+    switch (instr.kind()) {
+    case Tacky::Instruction::Kind::Return:
+        out.emplace_back(Instruction::Mov{
+            parse_operand(fn, instr.return_().val), Operand::Reg{Reg::AX}});
+        out.emplace_back(Instruction::Ret{});
+        break;
+    case Tacky::Instruction::Kind::Unary: {
+        const auto &unary = instr.unary();
+        auto dst = parse_operand(fn, unary.dst);
+        out.emplace_back(Instruction::Mov{parse_operand(fn, unary.src), dst});
+        out.emplace_back(Instruction::Unary{parse_unop(unary.op), dst});
+        break;
+    }
     }
 }
 
-std::unique_ptr<UnaryOperator>
-Generator::parse_unop(std::unique_ptr<Tacky::UnaryOperator> op) {
-    if (auto *comp = dynamic_cast<Tacky::Complement *>(op.get())) {
-        return std::make_unique<Not>();
-    } else {
-        return std::make_unique<Neg>();
+Operand Generator::parse_operand(const Tacky::Function &fn,
+                                 Tacky::Val operand) {
+    if (Tacky::is_constant(operand)) {
+        return Operand::Imm{Tacky::constant(fn, operand)};
     }
+    return Operand::Pseudo{Tacky::index(operand)};
 }
 
-Program Generator::replace_pseudo_registers(Program &program) {
-    std::vector<std::unique_ptr<Instruction>> stack_instrs{};
-    auto fn = program.fn_def();
-    for (auto &instr : fn.instructions()) {
-        if (auto *mov = dynamic_cast<Mov *>(instr.get())) {
-            auto stack_mov = std::make_unique<Mov>();
-            if (auto *reg = dynamic_cast<Pseudo *>(mov->src().get())) {
-                auto offset = next_stack_offset(reg->name());
-                stack_mov->set_src(std::make_unique<Stack>(offset));
-            } else {
-                stack_mov->set_src(std::move(mov->src()));
-            }
-
-            if (auto *reg = dynamic_cast<Pseudo *>(mov->dst().get())) {
-                auto offset = next_stack_offset(reg->name());
-                stack_mov->set_dst(std::make_unique<Stack>(offset));
-            } else {
-                stack_mov->set_dst(std::move(mov->dst()));
-            }
-            stack_instrs.emplace_back(std::move(stack_mov));
-        } else if (auto *unary = dynamic_cast<Unary *>(instr.get())) {
-            auto stack_unary = std::make_unique<Unary>();
-            stack_unary->set_op(std::move(unary->op()));
-
-            if (auto *reg = dynamic_cast<Pseudo *>(unary->dst().get())) {
-                auto offset = next_stack_offset(reg->name());
-                stack_unary->set_dst(std::make_unique<Stack>(offset));
-            } else {
-                stack_unary->set_dst(std::move(unary->dst()));
-            }
-            stack_instrs.emplace_back(std::move(stack_unary));
-        } else {
-            stack_instrs.emplace_back(std::move(instr));
-        }
+UnaryOperator Generator::parse_unop(Tacky::UnaryOperator op) {
+    switch (op) {
+    case Tacky::UnaryOperator::Complement:
+        return UnaryOperator::Not;
+    case Tacky::UnaryOperator::Negate:
+        return UnaryOperator::Neg;
     }
+    __builtin_unreachable();
+}
+
+Operand Generator::replace_pseudo(Operand operand) {
+    if (operand.is(Operand::Kind::Pseudo)) {
+        return Operand::Stack{stack_slot(operand.pseudo().reg)};
+    }
+    return operand;
+}
 
-    return Program(FunctionDef(fn.name(), std::move(stack_instrs)));
+FunctionDef Generator::replace_pseudo_registers(const FunctionDef &fn) {
+    std::pmr::vector<Instruction> stack_instrs(
+        fn.instructions.begin(), fn.instructions.end(), &_arena);
+    for (auto &instr : stack_instrs) {
+        switch (instr.kind()) {
+        case Instruction::Kind::Mov:
+            instr.mov().src = replace_pseudo(instr.mov().src);
+            instr.mov().dst = replace_pseudo(instr.mov().dst);
+            break;
+        case Instruction::Kind::Unary:
+            instr.unary().dst = replace_pseudo(instr.unary().dst);
+            break;
+        case Instruction::Kind::AllocateStack:
+        case Instruction::Kind::Ret:
+            break;
+        }
+    }
+    return FunctionDef{fn.name, _arena.adopt(stack_instrs)};
 }
 
-Program Generator::fixup_instructions(Program &program) {
-    auto fn = program.fn_def();
-    std::vector<std::unique_ptr<Instruction>> expanded_instrs{};
+FunctionDef Generator::fixup_instructions(const FunctionDef &fn) {
+    std::pmr::vector<Instruction> expanded_instrs(&_arena);
+    // at most two instructions for each one, plus the stack allocation
+    expanded_instrs.reserve(fn.instructions.size() * 2 + 1);
 
-    // TODO: find or track the greatest stack offset since the current one will
-    // be different once this handles multiple functions
+    // the pseudo registers of this function have all been assigned by now
     expanded_instrs.emplace_back(
-        std::make_unique<AllocateStack>(_stack_offset));
+        Instruction::AllocateStack{std::abs(_stack_offset)});
 
-    for (auto &instr : fn.instructions()) {
+    for (const auto &instr : fn.instructions) {
         // expand Mov with two Stacks
-        if (auto *mov = dynamic_cast<Mov *>(instr.get())) {
-            auto *src = dynamic_cast<Stack *>(mov->src().get());
-            auto *dst = dynamic_cast<Stack *>(mov->dst().get());
-            if (src && dst) {
-                expanded_instrs.emplace_back(std::make_unique<Mov>(
-                    std::move(mov->src()),
-                    std::make_unique<Reg>(std::make_unique<R10>())));
-                expanded_instrs.emplace_back(std::make_unique<Mov>(
-                    std::make_unique<Reg>(std::make_unique<R10>()),
-                    std::move(mov->dst())));
-                continue;
-            }
+        if (instr.is(Instruction::Kind::Mov) &&
+            instr.mov().src.is(Operand::Kind::Stack) &&
+            instr.mov().dst.is(Operand::Kind::Stack)) {
+            Operand r10 = Operand::Reg{Reg::R10};
+            expanded_instrs.emplace_back(
+                Instruction::Mov{instr.mov().src, r10});
+            expanded_instrs.emplace_back(
+                Instruction::Mov{r10, instr.mov().dst});
+            continue;
         }
-        expanded_instrs.emplace_back(std::move(instr));
+        expanded_instrs.push_back(instr);
     }
 
-    return Program(FunctionDef(fn.name(), std::move(expanded_instrs)));
+    return FunctionDef{fn.name, _arena.adopt(expanded_instrs)};
 }
 
-int Generator::next_stack_offset(std::string key) {
-    auto iter = _cache.find(key);
-    if (iter != _cache.end()) {
-        return iter->second;
+// Registers are numbered densely, so their slots are found by indexing
+int Generator::stack_slot(std::uint32_t reg) {
+    if (reg >= _slots.size()) {
+        _slots.resize(reg + 1, 0);
     }
-    _stack_offset -= _offset_byte_size;
-    return _cache[key] = _stack_offset;
+    if (_slots[reg] == 0) {
+        _stack_offset -= _offset_byte_size;
+        _slots[reg] = _stack_offset;
+    }
+    return _slots[reg];
 }
 } // namespace Asm
 
 //// TESTS ////
 
+namespace {
+Asm::Operand pseudo(std::uint32_t reg) {
+    return Asm::Operand::Pseudo{reg};
+}
+
+// A TACKY function whose constant pool holds just 789
+struct TackyFixture {
+    std::int64_t constants[1]{789};
+    Tacky::Val constant = Tacky::pooled(0);
+
+    Tacky::Function function(std::span<const Tacky::Instruction> body) {
+        return {intern("main"), body, constants, 1};
+    }
+};
+
+Asm::FunctionDef asm_function(Arena &arena,
+                              const std::vector<Asm::Instruction> &instrs) {
+    return {intern("test"), arena.copy(instrs)};
+}
+
+std::vector<Asm::Instruction> parse(const Tacky::Instruction &instr) {
+    Arena arena{};
+    Asm::Generator gen(arena);
+    std::pmr::vector<Asm::Instruction> instrs(&arena);
+    TackyFixture tacky{};
+    gen.parse_instruction(tacky.function({&instr, 1}), instr, instrs);
+    return {instrs.begin(), instrs.end()};
+}
+} // namespace
+
 TEST_CASE("fixup_instructions expands mov instructions with temp register") {
-    std::vector<std::unique_ptr<Asm::Instruction>> instrs{};
-    auto mov1 = std::make_unique<Asm::Mov>(std::make_unique<Asm::Stack>(-4),
-                                           std::make_unique<Asm::Stack>(-8));
-    auto mov2 = std::make_unique<Asm::Mov>(std::make_unique<Asm::Imm>("13"),
-                                           std::make_unique<Asm::Stack>(-8));
-    instrs.emplace_back(std::move(mov1));
-    instrs.emplace_back(std::move(mov2));
-    auto program = Asm::Program(Asm::FunctionDef("test", std::move(instrs)));
-
-    Asm::Generator gen;
-    auto fixed_prog = gen.fixup_instructions(program);
-    auto fn_def = fixed_prog.fn_def();
-    auto &fixed_instrs = fn_def.instructions();
+    using Asm::Operand;
+    Arena arena{};
+    auto fn = asm_function(
+        arena, {Asm::Instruction::Mov{Operand::Stack{-4}, Operand::Stack{-8}},
+                Asm::Instruction::Mov{Operand::Imm{13}, Operand::Stack{-8}}});
+
+    Asm::Generator gen(arena);
+    auto fixed_fn = gen.fixup_instructions(fn);
+    auto fixed_instrs = fixed_fn.instructions;
 
     CHECK(fixed_instrs.size() == 4);
-    CHECK(fixed_instrs[0]->to_string() == "subq $0, %rsp");
-    CHECK(fixed_instrs[1]->to_string() == "movl -4(%rbp), %r10d");
-    CHECK(fixed_instrs[2]->to_string() == "movl %r10d, -8(%rbp)");
-    CHECK(fixed_instrs[3]->to_string() == "movl $13, -8(%rbp)");
+    CHECK(to_string(fixed_instrs[0]) == "subq $0, %rsp");
+    CHECK(to_string(fixed_instrs[1]) == "movl -4(%rbp), %r10d");
+    CHECK(to_string(fixed_instrs[2]) == "movl %r10d, -8(%rbp)");
+    CHECK(to_string(fixed_instrs[3]) == "movl $13, -8(%rbp)");
 }
 
 TEST_CASE("fixup_instructions adds stack allocator") {
-    auto mov1 = std::make_unique<Asm::Mov>(
-        std::make_unique<Asm::Imm>("12"), std::make_unique<Asm::Pseudo>("a.0"));
-    auto mov2 = std::make_unique<Asm::Mov>(
-        std::make_unique<Asm::Imm>("13"), std::make_unique<Asm::Pseudo>("a.1"));
-    auto mov3 = std::make_unique<Asm::Mov>(
-        std::make_unique<Asm::Imm>("14"), std::make_unique<Asm::Pseudo>("a.2"));
-    std::vector<std::unique_ptr<Asm::Instruction>> instrs{};
-    instrs.emplace_back(std::move(mov1));
-    instrs.emplace_back(std::move(mov2));
-    instrs.emplace_back(std::move(mov3));
-    auto program = Asm::Program(Asm::FunctionDef("test", std::move(instrs)));
-
-    Asm::Generator gen;
-    auto stack_prog = gen.replace_pseudo_registers(program);
-    auto fixed_prog = gen.fixup_instructions(stack_prog);
-    auto fn_def = fixed_prog.fn_def();
-    auto &fixed_instrs = fn_def.instructions();
+    using Asm::Operand;
+    Arena arena{};
+    auto fn = asm_function(
+        arena,
+        {Asm::Instruction::Mov{Operand::Imm{12}, pseudo(0)},
+         Asm::Instruction::Mov{Operand::Imm{13}, pseudo(1)},
+         Asm::Instruction::Mov{Operand::Imm{14}, pseudo(2)}});
+
+    Asm::Generator gen(arena);
+    auto stack_fn = gen.replace_pseudo_registers(fn);
+    auto fixed_fn = gen.fixup_instructions(stack_fn);
+    auto fixed_instrs = fixed_fn.instructions;
 
     CHECK(fixed_instrs.size() == 4);
-    CHECK(fixed_instrs[0]->to_string() == "subq $12, %rsp");
-    CHECK(fixed_instrs[1]->to_string() == "movl $12, -4(%rbp)");
-    CHECK(fixed_instrs[2]->to_string() == "movl $13, -8(%rbp)");
-    CHECK(fixed_instrs[3]->to_string() == "movl $14, -12(%rbp)");
+    CHECK(to_string(fixed_instrs[0]) == "subq $12, %rsp");
+    CHECK(to_string(fixed_instrs[1]) == "movl $12, -4(%rbp)");
+    CHECK(to_string(fixed_instrs[2]) == "movl $13, -8(%rbp)");
+    CHECK(to_string(fixed_instrs[3]) == "movl $14, -12(%rbp)");
 }
 
 TEST_CASE("replace pseudo registers with stacks") {
-    auto mov1 = std::make_unique<Asm::Mov>(
-        std::make_unique<Asm::Imm>("12"), std::make_unique<Asm::Pseudo>("a.0"));
-    auto mov2 = std::make_unique<Asm::Mov>(
-        std::make_unique<Asm::Imm>("88"), std::make_unique<Asm::Pseudo>("a.1"));
-    auto unary = std::make_unique<Asm::Unary>(
-        std::make_unique<Asm::Neg>(), std::make_unique<Asm::Pseudo>("a.0"));
-    std::vector<std::unique_ptr<Asm::Instruction>> instrs{};
-    instrs.emplace_back(std::move(mov1));
-    instrs.emplace_back(std::move(mov2));
-    instrs.emplace_back(std::move(unary));
-    instrs.emplace_back(std::make_unique<Asm::Ret>());
-    auto program = Asm::Program(Asm::FunctionDef("test", std::move(instrs)));
-
-    Asm::Generator gen;
-    auto stack_prog = gen.replace_pseudo_registers(program);
-    auto fn_def = stack_prog.fn_def();
-    auto &stack_instrs = fn_def.instructions();
+    using Asm::Operand;
+    Arena arena{};
+    auto fn = asm_function(
+        arena,
+        {Asm::Instruction::Mov{Operand::Imm{12}, pseudo(0)},
+         Asm::Instruction::Mov{Operand::Imm{88}, pseudo(1)},
+         Asm::Instruction::Unary{Asm::UnaryOperator::Neg, pseudo(0)},
+         Asm::Instruction::Ret{}});
+
+    Asm::Generator gen(arena);
+    auto stack_fn = gen.replace_pseudo_registers(fn);
+    auto stack_instrs = stack_fn.instructions;
 
     CHECK(stack_instrs.size() == 4);
-    CHECK(stack_instrs[0]->to_string() == "movl $12, -4(%rbp)");
-    CHECK(stack_instrs[1]->to_string() == "movl $88, -8(%rbp)");
-    CHECK(stack_instrs[2]->to_string() == "negl -4(%rbp)");
-    CHECK(stack_instrs[3]->to_string() == "ret");
+    CHECK(to_string(stack_instrs[0]) == "movl $12, -4(%rbp)");
+    CHECK(to_string(stack_instrs[1]) == "movl $88, -8(%rbp)");
+    CHECK(to_string(stack_instrs[2]) == "negl -4(%rbp)");
+    CHECK(to_string(stack_instrs[3]) == "ret");
+    CHECK(dump(stack_instrs[2]) == "Unary(Neg, Stack(-4))");
 }
 
 TEST_CASE("convert tacky to assembly") {
-    std::vector<std::unique_ptr<Tacky::Instruction>> tacky_instrs{};
-    auto instr = std::make_unique<Tacky::Return>(
-        std::make_unique<Tacky::Constant>("789"));
-    tacky_instrs.emplace_back(std::move(instr));
-    auto fn =
-        std::make_unique<Tacky::Function>("main", std::move(tacky_instrs));
-
-    Tacky::Program tacky_ir(std::move(fn));
+    Arena arena{};
+    TackyFixture tacky{};
+    Tacky::Instruction body[]{Tacky::Instruction::Return{tacky.constant}};
+    auto fn = tacky.function(body);
 
-    Asm::Generator gen;
-    Asm::Program program = gen.convert_tacky_to_assembly(tacky_ir);
-    auto fn_def = program.fn_def();
-    auto &instrs = fn_def.instructions();
+    Asm::Generator gen(arena);
+    Asm::Program program = gen.convert_tacky_to_assembly({{&fn, 1}});
+    REQUIRE(program.functions.size() == 1);
+    auto instrs = program.functions[0].instructions;
 
-    CHECK(fn_def.name() == "main");
+    CHECK(program.functions[0].name == intern("main"));
     CHECK(instrs.size() == 2);
-    CHECK(instrs[0]->to_string() == "movl $789, %eax");
-    CHECK(instrs[1]->to_string() == "ret");
+    CHECK(to_string(instrs[0]) == "movl $789, %eax");
+    CHECK(to_string(instrs[1]) == "ret");
 }
 
 TEST_CASE("parsing a function definition without arguments") {
-    std::vector<std::unique_ptr<Tacky::Instruction>> tacky_instrs{};
-    auto instr = std::make_unique<Tacky::Return>(
-        std::make_unique<Tacky::Constant>("789"));
-    tacky_instrs.emplace_back(std::move(instr));
-    auto fn =
-        std::make_unique<Tacky::Function>("main", std::move(tacky_instrs));
-
-    Asm::Generator gen;
-    auto fn_def = gen.parse_func_def(std::move(fn));
-    auto &instrs = fn_def.instructions();
-
-    CHECK(fn_def.name() == "main");
+    Arena arena{};
+    TackyFixture tacky{};
+    Tacky::Instruction body[]{Tacky::Instruction::Return{tacky.constant}};
+
+    Asm::Generator gen(arena);
+    auto fn_def = gen.parse_func_def(tacky.function(body));
+    auto instrs = fn_def.instructions;
+
+    CHECK(fn_def.name == intern("main"));
     CHECK(instrs.size() == 2);
-    CHECK(instrs[0]->to_string() == "movl $789, %eax");
-    CHECK(instrs[1]->to_string() == "ret");
+    CHECK(to_string(instrs[0]) == "movl $789, %eax");
+    CHECK(to_string(instrs[1]) == "ret");
 }
 
 TEST_CASE("parsing a unary complement instruction") {
-    auto op = std::make_unique<Tacky::Complement>();
-    auto src = std::make_unique<Tacky::Constant>("789");
-    auto dst = std::make_unique<Tacky::Var>("tmp.0");
-    auto unary = std::make_unique<Tacky::Unary>(std::move(op), std::move(src),
-                                                std::move(dst));
-    Asm::Generator gen;
-    auto instrs = gen.parse_instruction(std::move(unary));
+    auto instrs = parse(Tacky::Instruction::Unary{
+        Tacky::UnaryOperator::Complement, Tacky::pooled(0), Tacky::reg(0)});
     CHECK(instrs.size() == 2);
-    CHECK(instrs[0]->to_string() == "movl $789, Pseudo(tmp.0)");
-    CHECK(instrs[1]->to_string() == "notl Pseudo(tmp.0)");
+    CHECK(to_string(instrs[0]) == "movl $789, Pseudo(0)");
+    CHECK(to_string(instrs[1]) == "notl Pseudo(0)");
 }
 
 TEST_CASE("parsing a unary negate instruction") {
-    auto op = std::make_unique<Tacky::Negate>();
-    auto src = std::make_unique<Tacky::Constant>("789");
-    auto dst = std::make_unique<Tacky::Var>("tmp.0");
-    auto unary = std::make_unique<Tacky::Unary>(std::move(op), std::move(src),
-                                                std::move(dst));
-    Asm::Generator gen;
-    auto instrs = gen.parse_instruction(std::move(unary));
+    auto instrs = parse(Tacky::Instruction::Unary{
+        Tacky::UnaryOperator::Negate, Tacky::pooled(0), Tacky::reg(0)});
     CHECK(instrs.size() == 2);
-    CHECK(instrs[0]->to_string() == "movl $789, Pseudo(tmp.0)");
-    CHECK(instrs[1]->to_string() == "negl Pseudo(tmp.0)");
+    CHECK(to_string(instrs[0]) == "movl $789, Pseudo(0)");
+    CHECK(to_string(instrs[1]) == "negl Pseudo(0)");
 }
 
 TEST_CASE("parsing a return instruction produces mov and ret instructions") {
-    auto val = std::make_unique<Tacky::Constant>("789");
-    auto instr = std::make_unique<Tacky::Return>(std::move(val));
-    Asm::Generator gen;
-    auto instrs = gen.parse_instruction(std::move(instr));
+    auto instrs = parse(Tacky::Instruction::Return{Tacky::pooled(0)});
     CHECK(instrs.size() == 2);
-    CHECK(instrs[0]->to_string() == "movl $789, %eax");
-    CHECK(instrs[1]->to_string() == "ret");
+    CHECK(to_string(instrs[0]) == "movl $789, %eax");
+    CHECK(to_string(instrs[1]) == "ret");
+}
+
+TEST_CASE("each function gets its own stack frame") {
+    Arena arena{};
+    Ast::Parser parser("int main(void) { return -1; }\n"
+                       "int helper(void) { return ~-2; }",
+                       arena);
+    Tacky::Generator tacky(arena);
+    auto tacky_ir = tacky.convert_ast(parser.parse());
+    Asm::Generator gen(arena);
+    auto program = gen.generate_assembly(tacky_ir);
+
+    REQUIRE(program.functions.size() == 2);
+    CHECK(to_string(program.functions[0].instructions[0]) == "subq $4, %rsp");
+    CHECK(to_string(program.functions[1].instructions[0]) == "subq $8, %rsp");
+    CHECK(to_string(program.functions[1].instructions[1]) ==
+          "movl $2, -4(%rbp)");
 }
 
 TEST_CASE("constants generate immediate values") {
-    std::unique_ptr<Tacky::Val> constant =
-        std::make_unique<Tacky::Constant>("42");
-    Asm::Generator gen;
-    auto operand = gen.parse_operand(constant);
-    std::unique_ptr<Asm::Imm> imm(dynamic_cast<Asm::Imm *>(operand.release()));
-    CHECK(imm->value() == "42");
+    Arena arena{};
+    Asm::Generator gen(arena);
+    TackyFixture tacky{};
+    auto fn = tacky.function({});
+    auto operand = gen.parse_operand(fn, tacky.constant);
+    REQUIRE(operand.is(Asm::Operand::Kind::Imm));
+    CHECK(operand.imm().value == 789);
+
+    auto pseudo = gen.parse_operand(fn, Tacky::reg(0));
+    REQUIRE(pseudo.is(Asm::Operand::Kind::Pseudo));
+    CHECK(pseudo.pseudo().reg == 0);
+}
+
+TEST_CASE("assembly nodes are stored inline") {
+    static_assert(sizeof(Asm::Operand) == 16);
+    static_assert(sizeof(Asm::Instruction) <= 40);
+    CHECK(dump(Asm::Operand{Asm::Operand::Reg{Asm::Reg::R10}}) == "Reg(R10)");
 }
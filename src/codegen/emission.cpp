@@ -1,7 +1,7 @@
 #include <format>
 #include <fstream>
 #include <iostream>
-#include <memory>
+#include <span>
 
 #include "emission.h"
 
@@ -13,31 +13,36 @@ std::string asm_filename(std::string filename) {
 std::string fn_prologue() { return "\tpushq %rbp\n\tmovq %rsp, %rbp\n"; }
 std::string fn_epilogue() { return "\tmovq %rbp, %rsp\n\tpopq %rbp\n"; }
 
-std::string
-format_instructions(std::vector<std::unique_ptr<Instruction>> &instrs) {
+std::string format_instructions(std::span<const Instruction> instrs) {
     std::string formatted_instrs{};
-    for (auto &instr : instrs) {
-        if (auto *ret = dynamic_cast<Ret *>(instr.get())) {
+    for (const auto &instr : instrs) {
+        if (instr.is(Instruction::Kind::Ret)) {
             formatted_instrs += fn_epilogue();
         }
-        formatted_instrs += std::format("\t{}\n", instr->to_string());
+        formatted_instrs += std::format("\t{}\n", to_string(instr));
     }
     return formatted_instrs;
 }
 
-std::string format_func_def(FunctionDef fn_def) {
-    return std::format("\t.globl {}\n{}:\n{}{}", fn_def.name(), fn_def.name(),
-                       fn_prologue(),
-                       format_instructions(fn_def.instructions()));
+std::string format_func_def(const FunctionDef &fn_def) {
+    auto name = fn_def.name.to_str();
+    return std::format("\t.globl {}\n{}:\n{}{}", name, name, fn_prologue(),
+                       format_instructions(fn_def.instructions));
 }
 
-void emit_code(Program &program, std::string source_filename) {
+void emit_code(const Program &program, std::string source_filename) {
     std::ofstream file(asm_filename(source_filename));
     if (file) {
-        file << format_func_def(program.fn_def());
+        emit_code(program, file);
+    }
+}
 
-        // add this as the last line on Linux to disable an executable stack
-        file << "\t.section .note.GNU-stack,\"\",@progbits\n";
+void emit_code(const Program &program, std::ostream &out) {
+    for (const auto &fn_def : program.functions) {
+        out << format_func_def(fn_def);
     }
-};
+
+    // add this as the last line on Linux to disable an executable stack
+    out << "\t.section .note.GNU-stack,\"\",@progbits\n";
+}
 } // namespace Asm
@@ -1,7 +1,11 @@
 #pragma once
 
+#include <ostream>
+
 #include "assembly.h"
 
 namespace Asm {
-void emit_code(Program &, std::string);
+// Writes the .s file next to the source file
+void emit_code(const Program &, std::string);
+void emit_code(const Program &, std::ostream &);
 }
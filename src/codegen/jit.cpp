@@ -0,0 +1,324 @@
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+#include <system_error>
+
+#include <sys/mman.h>
+
+#include "../doctest.h"
+#include "../fold.h"
+#include "../interpret.h"
+#include "../optimize.h"
+#include "../ssa.h"
+#include "jit.h"
+
+namespace Asm {
+namespace {
+constexpr unsigned RSP = 4;
+constexpr unsigned RBP = 5;
+
+unsigned number(Reg reg) {
+    switch (reg) {
+    case Reg::AX:
+        return 0;
+    case Reg::R10:
+        return 10;
+    }
+    __builtin_unreachable();
+}
+
+// Encodes the 32-bit forms the emitter writes: movl, notl and negl on
+// %eax, %r10d and %rbp-relative stack slots
+class Encoder {
+    std::vector<std::uint8_t> &_out;
+
+    void byte(unsigned value) {
+        _out.push_back(static_cast<std::uint8_t>(value));
+    }
+    void imm32(std::int64_t value) {
+        // The assembler keeps the low 32 bits of a wider immediate
+        auto bits = static_cast<std::uint32_t>(value);
+        for (int i = 0; i < 4; i++) {
+            byte(bits >> (8 * i) & 0xff);
+        }
+    }
+    // Only %r10 needs a REX prefix; 32-bit operations need no REX.W
+    void rex(unsigned reg, unsigned rm) {
+        if (reg >= 8 || rm >= 8) {
+            byte(0x40 | (reg >= 8) << 2 | (rm >= 8));
+        }
+    }
+
+    // `opcode` with a ModRM byte holding `reg` and addressing `rm`
+    void modrm(unsigned opcode, unsigned reg, const Operand &rm) {
+        switch (rm.kind()) {
+        case Operand::Kind::Reg: {
+            auto number = Asm::number(rm.reg().reg);
+            rex(reg, number);
+            byte(opcode);
+            byte(0xc0 | (reg & 7) << 3 | (number & 7));
+            return;
+        }
+        case Operand::Kind::Stack: {
+            auto offset = rm.stack().offset;
+            rex(reg, RBP);
+            byte(opcode);
+            if (offset >= -128 && offset <= 127) {
+                byte(0x40 | (reg & 7) << 3 | RBP);
+                byte(static_cast<std::uint8_t>(offset));
+            } else {
+                byte(0x80 | (reg & 7) << 3 | RBP);
+                imm32(offset);
+            }
+            return;
+        }
+        case Operand::Kind::Imm:
+        case Operand::Kind::Pseudo:
+            break;
+        }
+        throw std::invalid_argument("Cannot encode " + to_string(rm) +
+                                    " as a destination");
+    }
+
+    void mov(const Operand &src, const Operand &dst) {
+        switch (src.kind()) {
+        case Operand::Kind::Imm:
+            if (dst.is(Operand::Kind::Reg)) {
+                auto number = Asm::number(dst.reg().reg);
+                rex(0, number);
+                byte(0xb8 + (number & 7));
+            } else {
+                modrm(0xc7, 0, dst);
+            }
+            imm32(src.imm().value);
+            return;
+        case Operand::Kind::Reg:
+            modrm(0x89, number(src.reg().reg), dst);
+            return;
+        case Operand::Kind::Stack:
+            if (dst.is(Operand::Kind::Reg)) {
+                modrm(0x8b, number(dst.reg().reg), src);
+                return;
+            }
+            break;
+        case Operand::Kind::Pseudo:
+            break;
+        }
+        throw std::invalid_argument("Cannot encode movl " + to_string(src) +
+                                    ", " + to_string(dst));
+    }
+
+  public:
+    explicit Encoder(std::vector<std::uint8_t> &out) : _out(out) {}
+
+    void prologue() {
+        byte(0x55);                         // pushq %rbp
+        byte(0x48), byte(0x89), byte(0xe5); // movq %rsp, %rbp
+    }
+
+    void instruction(const Instruction &instr) {
+        switch (instr.kind()) {
+        case Instruction::Kind::Mov:
+            mov(instr.mov().src, instr.mov().dst);
+            return;
+        case Instruction::Kind::Unary:
+            modrm(0xf7, instr.unary().op == UnaryOperator::Not ? 2 : 3,
+                  instr.unary().dst);
+            return;
+        case Instruction::Kind::AllocateStack: {
+            // subq $size, %rsp, with a byte immediate when it fits
+            auto size = instr.allocate_stack().size;
+            bool short_form = size >= -128 && size <= 127;
+            byte(0x48), byte(short_form ? 0x83 : 0x81);
+            byte(0xc0 | 5 << 3 | RSP);
+            if (short_form) {
+                byte(static_cast<std::uint8_t>(size));
+            } else {
+                imm32(size);
+            }
+            return;
+        }
+        case Instruction::Kind::Ret:
+            byte(0x48), byte(0x89), byte(0xec); // movq %rbp, %rsp
+            byte(0x5d);                         // popq %rbp
+            byte(0xc3);                         // ret
+            return;
+        }
+    }
+};
+} // namespace
+
+void encode(const FunctionDef &fn, std::vector<std::uint8_t> &out) {
+    Encoder encoder(out);
+    encoder.prologue();
+    for (const auto &instr : fn.instructions) {
+        encoder.instruction(instr);
+    }
+}
+
+JitCode::JitCode(const Program &program) {
+    std::vector<std::uint8_t> code{};
+    for (const auto &fn : program.functions) {
+        _entries.emplace_back(fn.name, code.size());
+        encode(fn, code);
+    }
+    if (code.empty()) {
+        return;
+    }
+
+    // Written while writable, then made executable, never both at once
+    _size = code.size();
+    _code = ::mmap(nullptr, _size, PROT_READ | PROT_WRITE,
+                   MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (_code == MAP_FAILED) {
+        _code = nullptr;
+        throw std::system_error(errno, std::generic_category(),
+                                "Failed to map JIT code");
+    }
+    std::memcpy(_code, code.data(), _size);
+    if (::mprotect(_code, _size, PROT_READ | PROT_EXEC) != 0) {
+        auto error = errno;
+        ::munmap(_code, _size);
+        _code = nullptr;
+        throw std::system_error(error, std::generic_category(),
+                                "Failed to make JIT code executable");
+    }
+}
+
+JitCode::~JitCode() {
+    if (_code) {
+        ::munmap(_code, _size);
+    }
+}
+
+JitCode::Entry JitCode::entry(Symbol name) const {
+    for (const auto &[symbol, offset] : _entries) {
+        if (symbol == name) {
+            return reinterpret_cast<Entry>(static_cast<char *>(_code) +
+                                           offset);
+        }
+    }
+    return nullptr;
+}
+} // namespace Asm
+
+//// TESTS ////
+
+namespace {
+using Asm::Instruction;
+using Asm::Operand;
+
+std::vector<std::uint8_t> bytes(const std::vector<Instruction> &instrs) {
+    Arena arena{};
+    std::vector<std::uint8_t> out{};
+    Asm::encode({intern("f"), arena.copy(instrs)}, out);
+    // Without the prologue
+    return {out.begin() + 4, out.end()};
+}
+
+using Bytes = std::vector<std::uint8_t>;
+} // namespace
+
+TEST_CASE("encode matches the assembler for movl") {
+    Operand eax = Operand::Reg{Asm::Reg::AX};
+    Operand r10d = Operand::Reg{Asm::Reg::R10};
+    CHECK(bytes({Instruction::Mov{Operand::Imm{2}, eax}}) ==
+          Bytes{0xb8, 0x02, 0x00, 0x00, 0x00});
+    CHECK(bytes({Instruction::Mov{Operand::Imm{-1}, r10d}}) ==
+          Bytes{0x41, 0xba, 0xff, 0xff, 0xff, 0xff});
+    CHECK(bytes({Instruction::Mov{Operand::Imm{7}, Operand::Stack{-4}}}) ==
+          Bytes{0xc7, 0x45, 0xfc, 0x07, 0x00, 0x00, 0x00});
+    CHECK(bytes({Instruction::Mov{Operand::Stack{-4}, r10d}}) ==
+          Bytes{0x44, 0x8b, 0x55, 0xfc});
+    CHECK(bytes({Instruction::Mov{r10d, Operand::Stack{-400}}}) ==
+          Bytes{0x44, 0x89, 0x95, 0x70, 0xfe, 0xff, 0xff});
+    CHECK(bytes({Instruction::Mov{Operand::Stack{-8}, eax}}) ==
+          Bytes{0x8b, 0x45, 0xf8});
+}
+
+TEST_CASE("encode matches the assembler for the other instructions") {
+    CHECK(bytes({Instruction::Unary{Asm::UnaryOperator::Not,
+                                    Operand::Stack{-4}}}) ==
+          Bytes{0xf7, 0x55, 0xfc});
+    CHECK(bytes({Instruction::Unary{Asm::UnaryOperator::Neg,
+                                    Operand::Reg{Asm::Reg::R10}}}) ==
+          Bytes{0x41, 0xf7, 0xda});
+    CHECK(bytes({Instruction::AllocateStack{8}}) ==
+          Bytes{0x48, 0x83, 0xec, 0x08});
+    CHECK(bytes({Instruction::AllocateStack{400}}) ==
+          Bytes{0x48, 0x81, 0xec, 0x90, 0x01, 0x00, 0x00});
+    CHECK(bytes({Instruction::Ret{}}) == Bytes{0x48, 0x89, 0xec, 0x5d, 0xc3});
+}
+
+TEST_CASE("encode rejects operands the emitter never writes") {
+    CHECK_THROWS_AS(bytes({Instruction::Mov{Operand::Stack{-4},
+                                            Operand::Stack{-8}}}),
+                    std::invalid_argument);
+    CHECK_THROWS_AS(bytes({Instruction::Unary{Asm::UnaryOperator::Neg,
+                                              Operand::Pseudo{0}}}),
+                    std::invalid_argument);
+}
+
+TEST_CASE("JitCode runs compiled functions in-process") {
+    Arena arena{};
+    Ast::Parser parser("int one(void) { return -(-1); }\n"
+                       "int main(void) { return ~(-(~(-(~2147483647)))); }",
+                       arena);
+    auto ast = parser.parse();
+    Tacky::Generator tacky(arena);
+    Asm::Generator gen(arena);
+    std::vector<Asm::FunctionDef> functions{};
+    for (const auto &fn : ast.functions) {
+        functions.push_back(gen.generate_function(tacky.convert_function(fn)));
+    }
+
+    Asm::JitCode code(Asm::Program{arena.copy(functions)});
+    REQUIRE(code.entry(intern("main")));
+    CHECK(code.entry(intern("main"))() == 2147483646);
+    CHECK(code.entry(intern("one"))() == 1);
+    CHECK_FALSE(code.entry(intern("two")));
+}
+
+TEST_CASE("JitCode agrees with the interpreter on boundary constants") {
+    constexpr std::string_view constants[] = {
+        "0",          "255",        "256",
+        "2147483647", "2147483648", "4294967296",
+        "9223372036854775807",
+    };
+    std::uint32_t seed = 2024;
+    auto next = [&](std::uint32_t bound) {
+        seed = seed * 1103515245 + 12345;
+        return (seed >> 8) % bound;
+    };
+
+    for (auto constant : constants) {
+        for (int chain = 0; chain < 20; chain++) {
+            // Parenthesized, since "--" is a decrement
+            std::string exp(constant);
+            for (auto length = next(8); length > 0; length--) {
+                exp = std::string(next(2) ? "-" : "~") + "(" + exp + ")";
+            }
+            auto source = "int main(void) { return " + exp + "; }";
+            CAPTURE(source);
+
+            for (bool optimized : {false, true}) {
+                Arena arena{};
+                Ast::Parser parser(source, arena);
+                auto ast = parser.parse().functions[0];
+                Tacky::Generator tacky(arena);
+                auto fn = tacky.convert_function(
+                    optimized ? Ast::fold(ast, arena) : ast);
+                if (optimized) {
+                    Tacky::PassStats stats{};
+                    fn = Tacky::from_ssa(Tacky::optimize(fn, arena, stats),
+                                         arena);
+                }
+                Asm::Generator gen(arena);
+                std::vector<Asm::FunctionDef> functions{
+                    gen.generate_function(fn)};
+                Asm::JitCode code(Asm::Program{arena.copy(functions)});
+                CHECK(code.entry(intern("main"))() == Tacky::run(fn));
+            }
+        }
+    }
+}
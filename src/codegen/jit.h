@@ -0,0 +1,37 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+#include "assembly.h"
+
+namespace Asm {
+// Appends the machine code for `fn` to `out`, byte for byte what the
+// assembler makes of the emitted text, prologue and epilogues included.
+// `fn` must have been through fixup_instructions.
+void encode(const FunctionDef &fn, std::vector<std::uint8_t> &out);
+
+// A program's machine code in executable memory, for running it in-process
+// without writing a .s file or calling the assembler and linker. Functions
+// never call each other, so no relocation is needed.
+class JitCode {
+    void *_code{nullptr};
+    std::size_t _size{};
+    std::vector<std::pair<Symbol, std::size_t>> _entries{};
+
+  public:
+    using Entry = int (*)();
+
+    // Throws std::system_error if the memory cannot be mapped executable
+    explicit JitCode(const Program &);
+    ~JitCode();
+
+    JitCode(const JitCode &) = delete;
+    JitCode &operator=(const JitCode &) = delete;
+
+    // The function called `name`, or nullptr if there is none
+    [[nodiscard]] Entry entry(Symbol name) const;
+};
+} // namespace Asm
@@ -0,0 +1,183 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+#include <utility>
+
+#include "scan.h"
+
+// Shape of a LexerDfa built from a set of spellings, computed first so the
+// tables can be sized exactly.
+struct DfaShape {
+    std::size_t states{};
+    std::size_t classes{};
+};
+
+// Lexer automaton generated at compile time from a table of reserved
+// spellings. Punctuators become a trie of states, words and numbers become
+// the Identifier and Integer states, and bytes are folded into equivalence
+// classes so the transition table stays dense: one row per state, one column
+// per class. Keywords are accepted as identifiers; callers tell them apart
+// with the reserved-word hash after the run is known.
+template <typename Kind, std::size_t States, std::size_t Classes>
+class LexerDfa {
+  public:
+    using State = std::uint8_t;
+    static_assert(States <= 256, "LexerDfa: widen State");
+
+    static constexpr State REJECT = 0;
+    static constexpr State START = 1;
+    static constexpr State IDENTIFIER = 2;
+    static constexpr State INTEGER = 3;
+    static constexpr State FIRST_PUNCTUATOR = 4;
+
+    static constexpr std::uint8_t OTHER = 0;
+    static constexpr std::uint8_t WORD = 1;
+    static constexpr std::uint8_t DIGIT = 2;
+    static constexpr std::uint8_t FIRST_PUNCTUATION = 3;
+
+    struct Match {
+        Kind kind{};            // Kind{} when nothing matched
+        std::size_t length{};
+        bool truncated{};       // input ended before the token did
+    };
+
+  private:
+    std::array<std::uint8_t, 256> _classes{};
+    std::array<State, States * Classes> _next{};
+    std::array<Kind, States> _accept{};
+
+    static constexpr bool is_word(std::string_view spelling) {
+        return Scan::is_ident_start(spelling[0]);
+    }
+
+  public:
+    template <std::size_t N>
+    constexpr LexerDfa(const std::array<std::pair<Kind, std::string_view>, N>
+                           &entries,
+                       Kind identifier, Kind integer) {
+        for (int byte = 0; byte < 256; byte++) {
+            auto ch = static_cast<char>(byte);
+            _classes[byte] = Scan::is_ident_start(ch) ? WORD
+                             : Scan::is_digit(ch)     ? DIGIT
+                                                      : OTHER;
+        }
+        auto next_class = FIRST_PUNCTUATION;
+        for (const auto &[_, spelling] : entries) {
+            if (is_word(spelling)) {
+                continue;
+            }
+            for (char ch : spelling) {
+                auto &cls = _classes[static_cast<unsigned char>(ch)];
+                if (cls == WORD || cls == DIGIT) {
+                    throw "LexerDfa: punctuators may not contain word bytes";
+                }
+                if (cls == OTHER) {
+                    cls = next_class++;
+                }
+            }
+        }
+
+        _next[START * Classes + WORD] = IDENTIFIER;
+        _next[IDENTIFIER * Classes + WORD] = IDENTIFIER;
+        _next[IDENTIFIER * Classes + DIGIT] = IDENTIFIER;
+        _next[START * Classes + DIGIT] = INTEGER;
+        _next[INTEGER * Classes + DIGIT] = INTEGER;
+        _accept[IDENTIFIER] = identifier;
+        _accept[INTEGER] = integer;
+
+        // Punctuator trie; each state is the prefix that reaches it
+        State states = FIRST_PUNCTUATOR;
+        for (const auto &[kind, spelling] : entries) {
+            if (is_word(spelling)) {
+                continue;
+            }
+            State state = START;
+            for (std::size_t len = 1; len <= spelling.size(); len++) {
+                auto &next = _next[state * Classes +
+                                   _classes[static_cast<unsigned char>(
+                                       spelling[len - 1])]];
+                if (next == REJECT) {
+                    next = states++;
+                }
+                state = next;
+            }
+            _accept[state] = kind;
+        }
+    }
+
+    template <std::size_t N>
+    static constexpr DfaShape
+    shape(const std::array<std::pair<Kind, std::string_view>, N> &entries) {
+        // Distinct punctuator bytes and distinct punctuator prefixes
+        DfaShape shape{FIRST_PUNCTUATOR, FIRST_PUNCTUATION};
+        std::array<bool, 256> seen{};
+        for (std::size_t i = 0; i < N; i++) {
+            auto spelling = entries[i].second;
+            if (is_word(spelling)) {
+                continue;
+            }
+            for (std::size_t len = 1; len <= spelling.size(); len++) {
+                auto byte = static_cast<unsigned char>(spelling[len - 1]);
+                shape.classes += !seen[byte];
+                seen[byte] = true;
+
+                bool repeated = false;
+                for (std::size_t j = 0; j < i && !repeated; j++) {
+                    auto other = entries[j].second;
+                    repeated = !is_word(other) && other.size() >= len &&
+                               other.substr(0, len) == spelling.substr(0, len);
+                }
+                shape.states += !repeated;
+            }
+        }
+        return shape;
+    }
+
+    [[nodiscard]] constexpr State step(State state, char ch) const {
+        auto cls = _classes[static_cast<unsigned char>(ch)];
+        return _next[state * Classes + cls];
+    }
+
+    [[nodiscard]] constexpr Kind accepts(State state) const {
+        return _accept[state];
+    }
+
+    // Longest token starting at `pos`. Identifier and integer runs are
+    // finished with the vectorized scanners instead of byte by byte.
+    [[nodiscard]] Match longest_match(std::string_view source,
+                                      std::size_t pos) const {
+        Match match{};
+        State state = START;
+        std::size_t end = pos;
+        while (end < source.size()) {
+            state = step(state, source[end++]);
+            if (state == REJECT) {
+                break;
+            }
+            if (state == IDENTIFIER) {
+                end = Scan::identifier_end(source, end);
+            } else if (state == INTEGER) {
+                end = Scan::digits_end(source, end);
+            }
+            if (accepts(state) != Kind{}) {
+                match.kind = accepts(state);
+                match.length = end - pos;
+            }
+        }
+        match.truncated = state != REJECT;
+        return match;
+    }
+};
+
+// Builds the LexerDfa for `entries`, e.g.
+//   constexpr auto DFA = make_lexer_dfa<RESERVED_STRINGS>(Id, Int);
+template <const auto &Entries, typename Kind>
+constexpr auto make_lexer_dfa(Kind identifier, Kind integer) {
+    using Probe = LexerDfa<Kind, 1, 1>;
+    constexpr auto shape = Probe::shape(Entries);
+    return LexerDfa<Kind, shape.states, shape.classes>(Entries, identifier,
+                                                       integer);
+}
@@ -0,0 +1,632 @@
+#include <algorithm>
+#include <cstdint>
+#include <unordered_set>
+#include <utility>
+
+#include "document.h"
+#include "doctest.h"
+#include "scan.h"
+
+namespace {
+// Tokens of a function before its statement: "int" <identifier> "(" "void"
+// ")" "{"; only "}" follows it
+constexpr std::size_t HEADER_TOKENS = 6;
+
+// The arena is rebuilt from the live extents once replaced nodes take up
+// this many times the space of live ones, and the arena has grown past the
+// minimum. Each rebuild parses what the edits since the last one left, so
+// its cost is spread over them.
+constexpr std::size_t COMPACT_RATIO = 4;
+constexpr std::size_t COMPACT_MIN = 64 * 1024;
+
+// Whether a token ending in `before` could grow into one starting with
+// `after` once the text around them changes: both are word bytes, or some
+// punctuator spells them in a row
+bool joins(char before, char after) {
+    if (Scan::is_ident(before) && Scan::is_ident(after)) {
+        return true;
+    }
+    for (const auto &[_, spelling] : RESERVED_STRINGS) {
+        for (std::size_t i = 1; i < spelling.size(); i++) {
+            if (spelling[i - 1] == before && spelling[i] == after) {
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+// Whether token `i` of `part`, lexed at `base`, is token `j` of `old` moved
+// by `shift` bytes
+bool same_token(const TokenBuffer &part, std::size_t i, std::uint32_t base,
+                const TokenBuffer &old, std::size_t j, std::int64_t shift) {
+    auto lexed = part[i];
+    auto kept = old[j];
+    if (lexed.kind != kept.kind ||
+        base + lexed.offset != static_cast<std::int64_t>(kept.offset) + shift) {
+        return false;
+    }
+    return lexed.is(TokenKind::Integer) ? part.value(i) == old.value(j)
+                                        : lexed.payload == kept.payload;
+}
+
+// Index of the first token at or after `offset`
+std::size_t token_at(const TokenBuffer &tokens, std::size_t offset) {
+    std::size_t lo = 0;
+    std::size_t hi = tokens.size();
+    while (lo < hi) {
+        auto mid = lo + (hi - lo) / 2;
+        if (tokens[mid].offset < offset) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    return lo;
+}
+} // namespace
+
+Document::Document(std::string text) : _text(std::move(text)) {
+    rebuild();
+    find_error();
+}
+
+void Document::edit(std::size_t offset, std::size_t length,
+                    std::string_view replacement) {
+    assert(offset + length <= _text.size());
+    _text.replace(offset, length, replacement);
+    if (!_lexed || !update(offset, length, replacement.size())) {
+        rebuild();
+    } else if (_arena->stats().used > COMPACT_RATIO * _live + COMPACT_MIN) {
+        compact();
+    }
+    find_error();
+}
+
+void Document::rebuild() {
+    _stats = {0, 0, true};
+    _arena.emplace();
+    _live = 0;
+    _functions.clear();
+    _extents.clear();
+    _names.clear();
+    _parsed = 0;
+    _broken = 0;
+    try {
+        _tokens = tokenize(_text);
+    } catch (const SyntaxError &error) {
+        _tokens = TokenBuffer(_text);
+        _lexed = false;
+        _error = error;
+        return;
+    }
+    _lexed = true;
+    _stats.relexed = _tokens.size();
+    reparse_extents(0, 0, 0, _tokens.size());
+}
+
+// Returns false when the edit needs a full rebuild instead
+bool Document::update(std::size_t offset, std::size_t removed,
+                      std::size_t added) {
+    std::string_view text = _text;
+    if (text.size() > UINT32_MAX) {
+        return false;
+    }
+    _stats = {};
+    auto shift = static_cast<std::int64_t>(added) -
+                 static_cast<std::int64_t>(removed);
+    auto new_end = offset + added;
+
+    // Relex from the token before the edit, which may grow into it, and
+    // from any tokens before that it could then merge with. Text before
+    // `offset` is unchanged.
+    auto lo = token_at(_tokens, offset);
+    auto first = lo > 0 ? lo - 1 : 0;
+    while (first > 0) {
+        auto at = _tokens[first].offset;
+        if (at == 0 || !joins(text[at - 1], text[at])) {
+            break;
+        }
+        first--;
+    }
+    auto start = static_cast<std::uint32_t>(
+        first < _tokens.size()
+            ? std::min<std::size_t>(_tokens[first].offset, offset)
+            : offset);
+
+    // Lex until a token starts where an old one did after the edit; the
+    // rest of the old tokens are then still valid, only moved
+    TokenBuffer part(text.substr(start));
+    auto last = first;
+    try {
+        Lexer lexer(text.substr(start));
+        for (;;) {
+            auto token = lexer.next();
+            if (token.is(TokenKind::Eof)) {
+                last = _tokens.size();
+                break;
+            }
+            auto at = start + token.offset;
+            if (at >= new_end) {
+                auto old_at = static_cast<std::int64_t>(at) - shift;
+                while (last < _tokens.size() &&
+                       _tokens[last].offset < old_at) {
+                    last++;
+                }
+                if (last < _tokens.size() && _tokens[last].offset == old_at) {
+                    break;
+                }
+            }
+            if (token.is(TokenKind::Integer)) {
+                part.push_integer(token, lexer.value(token));
+            } else {
+                part.push(token);
+            }
+        }
+    } catch (const SyntaxError &) {
+        return false;
+    }
+    _stats.relexed = part.size();
+
+    // Relexed tokens that came out as before need no reparse
+    auto count = part.size();
+    std::size_t prefix = 0;
+    while (prefix < count && first + prefix < last &&
+           same_token(part, prefix, start, _tokens, first + prefix, 0)) {
+        prefix++;
+    }
+    std::size_t suffix = 0;
+    while (prefix + suffix < count && first + prefix + suffix < last &&
+           same_token(part, count - 1 - suffix, start, _tokens,
+                      last - 1 - suffix, shift)) {
+        suffix++;
+    }
+    auto changed_first = first + prefix;
+    auto changed_last = last - suffix;
+    auto moved = static_cast<std::ptrdiff_t>(count) -
+                 static_cast<std::ptrdiff_t>(last - first);
+    _tokens.splice(text, first, last, part, start, shift);
+    if (changed_first == changed_last && count == prefix + suffix) {
+        return true;
+    }
+
+    // Extents holding the changed tokens, with the one before them when the
+    // change starts at an "int", which that extent's error may name
+    auto before = changed_first > 0 ? changed_first - 1 : 0;
+    auto ext_lo = std::min(
+        static_cast<std::size_t>(
+            std::partition_point(_extents.begin(), _extents.end(),
+                                 [&](const Extent &extent) {
+                                     return extent.end <= before;
+                                 }) -
+            _extents.begin()),
+        _extents.size() - 1);
+    auto ext_hi = std::max(
+        static_cast<std::size_t>(
+            std::partition_point(_extents.begin(), _extents.end(),
+                                 [&](const Extent &extent) {
+                                     return extent.begin < changed_last;
+                                 }) -
+            _extents.begin()),
+        ext_lo + 1);
+
+    if (ext_hi - ext_lo == 1) {
+        const auto &extent = _extents[ext_lo];
+        if (extent.parsed && !extent.error &&
+            changed_first >= extent.begin + HEADER_TOKENS &&
+            changed_last + 1 <= extent.end &&
+            reparse_statement(ext_lo, moved)) {
+            return true;
+        }
+    }
+    auto begin = _extents[ext_lo].begin;
+    auto end = static_cast<std::size_t>(
+        static_cast<std::ptrdiff_t>(_extents[ext_hi - 1].end) + moved);
+    auto extents = reparse_extents(ext_lo, ext_hi, begin, end);
+    move_extents(ext_lo + extents, moved);
+    return true;
+}
+
+// Parses the statement of the function in `extent` again, in place
+bool Document::reparse_statement(std::size_t extent, std::ptrdiff_t moved) {
+    auto &tokens = _extents[extent];
+    auto first = tokens.begin + HEADER_TOKENS;
+    auto last = tokens.end + moved - 1;
+    auto used = _arena->stats().used;
+    Ast::Parser parser(_tokens, first, last, *_arena);
+    try {
+        auto statement = parser.parse_statement();
+        if (!parser.at_end()) {
+            return false;
+        }
+        _functions[extent].body = statement;
+    } catch (const SyntaxError &) {
+        return false;
+    }
+    // The statement holds every node of the function
+    _live -= tokens.bytes;
+    tokens.bytes = _arena->stats().used - used;
+    _live += tokens.bytes;
+    _stats.reparsed = last - first;
+    tokens.end += moved;
+    move_extents(extent + 1, moved);
+    return true;
+}
+
+// Replaces extents [lo, hi) with those of tokens [first, last), however
+// many functions they now hold, and returns how many that is
+std::size_t Document::reparse_extents(std::size_t lo, std::size_t hi,
+                                      std::size_t first, std::size_t last) {
+    std::vector<Extent> extents{};
+    std::vector<Ast::Function> functions{};
+    for (auto begin = first, i = first + 1; i <= last; i++) {
+        if (i == last || _tokens.kind(i) == TokenKind::IntType) {
+            functions.emplace_back();
+            extents.push_back(parse_extent(begin, i, functions.back()));
+            begin = i;
+        }
+    }
+    if (extents.empty() && hi - lo == _extents.size()) {
+        // No tokens at all, which a full parse rejects too
+        functions.emplace_back();
+        extents.push_back(parse_extent(first, first, functions.back()));
+    }
+
+    for (auto i = lo; i < hi; i++) {
+        count(_extents[i], _functions[i], false);
+    }
+    for (std::size_t i = 0; i < extents.size(); i++) {
+        count(extents[i], functions[i], true);
+    }
+    _functions.erase(_functions.begin() + lo, _functions.begin() + hi);
+    _functions.insert(_functions.begin() + lo, functions.begin(),
+                      functions.end());
+    _extents.erase(_extents.begin() + lo, _extents.begin() + hi);
+    _extents.insert(_extents.begin() + lo, extents.begin(), extents.end());
+    return extents.size();
+}
+
+// Parses extent tokens [begin, end) as a function. The parser may read on
+// to the error a full parse would report, which is at most the "int" at
+// `end`.
+Document::Extent Document::parse_extent(std::size_t begin, std::size_t end,
+                                        Ast::Function &fn) {
+    Extent extent{begin, end};
+    _stats.reparsed += end - begin;
+    auto used = _arena->stats().used;
+    Ast::Parser parser(_tokens, begin, _tokens.size(), *_arena);
+    try {
+        fn = parser.parse_function();
+        extent.parsed = true;
+        parser.expect_next_function();
+    } catch (const SyntaxError &error) {
+        extent.error = error.what();
+        auto offset = error.offset().value_or(_text.size());
+        extent.error_at = token_at(_tokens, offset) - begin;
+    }
+    extent.bytes = _arena->stats().used - used;
+    return extent;
+}
+
+// Parses every extent again into a new arena, which drops the nodes of
+// replaced functions. Each extent comes out as before.
+void Document::compact() {
+    _stats.compacted = true;
+    _arena.emplace();
+    _live = 0;
+    for (std::size_t i = 0; i < _extents.size(); i++) {
+        const auto &extent = _extents[i];
+        _extents[i] = parse_extent(extent.begin, extent.end, _functions[i]);
+        _live += _extents[i].bytes;
+    }
+}
+
+// Adds or removes `extent`, holding `fn` if it parsed, from the counts
+void Document::count(const Extent &extent, const Ast::Function &fn,
+                     bool add) {
+    _live = add ? _live + extent.bytes : _live - extent.bytes;
+    if (extent.parsed) {
+        auto &named = _names[fn.name];
+        named = add ? named + 1 : named - 1;
+        if (named == 0) {
+            _names.erase(fn.name);
+        }
+        _parsed = add ? _parsed + 1 : _parsed - 1;
+    }
+    if (extent.error) {
+        _broken = add ? _broken + 1 : _broken - 1;
+    }
+}
+
+void Document::move_extents(std::size_t from, std::ptrdiff_t moved) {
+    if (moved == 0) {
+        return;
+    }
+    for (auto i = from; i < _extents.size(); i++) {
+        _extents[i].begin += moved;
+        _extents[i].end += moved;
+    }
+}
+
+// A full parse stops at the first extent that does not parse, or at the
+// first function whose name was taken, whichever comes first
+void Document::find_error() {
+    if (!_lexed) {
+        return; // the lexical error from rebuild()
+    }
+    _error.reset();
+    if (_broken == 0 && _names.size() == _parsed) {
+        return;
+    }
+    std::unordered_set<Symbol> names{};
+    for (std::size_t i = 0; i < _extents.size(); i++) {
+        const auto &extent = _extents[i];
+        if (extent.parsed && !names.insert(_functions[i].name).second) {
+            _error = Ast::redefinition(_functions[i].name,
+                                       _tokens[extent.begin + 1].offset);
+            return;
+        }
+        if (extent.error) {
+            auto at = extent.begin + extent.error_at;
+            auto offset = at < _tokens.size() ? _tokens[at].offset
+                                              : _text.size();
+            _error = SyntaxError(*extent.error,
+                                 static_cast<std::uint32_t>(offset));
+            return;
+        }
+    }
+}
+
+//// TESTS ////
+
+namespace {
+// The tree a full parse of the document's current text gives
+std::string reparsed(const Document &document) {
+    Arena arena{};
+    Ast::Parser parser(document.text(), arena);
+    return Ast::dump(parser.parse());
+}
+
+void check_tokens(const Document &document) {
+    auto fresh = tokenize(document.text());
+    REQUIRE(document.tokens().size() == fresh.size());
+    for (std::size_t i = 0; i < fresh.size(); i++) {
+        CHECK(document.tokens()[i].kind == fresh[i].kind);
+        CHECK(document.tokens()[i].offset == fresh[i].offset);
+        CHECK(document.tokens().to_str(i) == fresh.to_str(i));
+    }
+}
+
+std::string functions(std::size_t count) {
+    std::string text{};
+    for (std::size_t i = 0; i < count; i++) {
+        text += std::format("int f{}(void) {{ return -{}; }}\n", i, i);
+    }
+    return text;
+}
+} // namespace
+
+TEST_CASE("Document parses its initial text") {
+    Document document("int main(void) { return ~2; }");
+    REQUIRE(!document.error());
+    CHECK(document.stats().full);
+    CHECK(Ast::dump(document.program()) == reparsed(document));
+}
+
+TEST_CASE("Document reparses only the edited statement") {
+    Document document(functions(100));
+    auto at = document.text().find("-50;");
+    document.edit(at, 3, "~(-12345)");
+    REQUIRE(!document.error());
+    CHECK(!document.stats().full);
+    CHECK(document.stats().relexed <= 8);
+    CHECK(document.stats().reparsed <= 8);
+    CHECK(Ast::dump(document.program()) == reparsed(document));
+    check_tokens(document);
+}
+
+TEST_CASE("Document skips the parser when no token changes") {
+    Document document(functions(10));
+    document.edit(0, 0, "   \n");
+    document.edit(document.text().find("return"), 0, "  ");
+    REQUIRE(!document.error());
+    CHECK(!document.stats().full);
+    CHECK(document.stats().reparsed == 0);
+    check_tokens(document);
+}
+
+TEST_CASE("joins follows the lexer's character classes and punctuators") {
+    CHECK(joins('f', '1'));
+    CHECK(joins('_', 'x'));
+    CHECK(joins('-', '-'));
+    CHECK_FALSE(joins('-', '~'));
+    CHECK_FALSE(joins(')', '('));
+    // Bytes outside ASCII are never word bytes, whatever the locale
+    CHECK_FALSE(joins('\xe9', 'a'));
+}
+
+TEST_CASE("Document relexes tokens that merge across the edit") {
+    Document document("int main(void) { return 12 ; }");
+    auto at = document.text().find(' ', document.text().find("12"));
+    document.edit(at, 1, "");
+    document.edit(at - 2, 0, "3");
+    REQUIRE(!document.error());
+    CHECK(Ast::dump(document.program()) ==
+          "Program([Function(main, Return(Constant(312)))])");
+    check_tokens(document);
+
+    // "f1" + "2" is still one identifier
+    Document names(functions(3));
+    names.edit(names.text().find("f1") + 2, 0, "2");
+    REQUIRE(!names.error());
+    CHECK(names.program().functions[1].name.to_str() == "f12");
+    check_tokens(names);
+}
+
+TEST_CASE("Document splits and joins functions") {
+    Document document(functions(5));
+    auto at = document.text().find("int f2");
+    document.edit(at, 0, "int g(void) { return 7; } ");
+    REQUIRE(!document.error());
+    CHECK(!document.stats().full);
+    REQUIRE(document.program().functions.size() == 6);
+    CHECK(Ast::dump(document.program()) == reparsed(document));
+
+    // Delete the new function again
+    document.edit(at, std::string_view("int g(void) { return 7; } ").size(),
+                  "");
+    REQUIRE(!document.error());
+    CHECK(document.program().functions.size() == 5);
+    CHECK(Ast::dump(document.program()) == reparsed(document));
+    check_tokens(document);
+}
+
+TEST_CASE("Document keeps syntax errors and recovers from them") {
+    Document document(functions(3));
+    auto at = document.text().find("-1;");
+    document.edit(at + 2, 1, "");
+    REQUIRE(document.error());
+    CHECK(std::string(document.error()->what()) ==
+          "Expected \";\" but got \"}\"");
+
+    document.edit(at + 2, 0, ";");
+    REQUIRE(!document.error());
+    CHECK(!document.stats().full);
+    CHECK(Ast::dump(document.program()) == reparsed(document));
+
+    Document twice(functions(3));
+    twice.edit(twice.text().find("f2"), 2, "f0");
+    REQUIRE(twice.error());
+    CHECK(std::string(twice.error()->what()) ==
+          "Redefinition of function f0");
+
+    Document broken("int main(void) { return $; }");
+    CHECK(broken.error());
+    broken.edit(broken.text().find('$'), 1, "4");
+    REQUIRE(!broken.error());
+    CHECK(Ast::dump(broken.program()) ==
+          "Program([Function(main, Return(Constant(4)))])");
+}
+
+TEST_CASE("Document stays incremental while the text has an error") {
+    Document document(functions(100));
+    auto broken = document.text().find("-10;");
+    document.edit(broken + 3, 1, "");
+    REQUIRE(document.error());
+    auto offset = document.error()->offset();
+
+    // Edits far from the error reparse one function and keep the error
+    for (int i = 0; i < 3; i++) {
+        document.edit(document.text().find("-80;"), 3, "~(-80)");
+        document.edit(document.text().find("int f90"), 0, "int g(void) { "
+                                                         "return 1; } ");
+        document.edit(document.text().find("int g"),
+                      std::string_view("int g(void) { return 1; } ").size(),
+                      "");
+        document.edit(document.text().find("~(-80)"), 6, "-80");
+        REQUIRE(document.error());
+        CHECK(document.error()->offset() == offset);
+        CHECK(!document.stats().full);
+        CHECK(document.stats().relexed <= 16);
+        CHECK(document.stats().reparsed <= 32);
+    }
+
+    // An earlier error takes over, and fixing it brings the later one back
+    auto early = document.text().find("-3;");
+    document.edit(early + 2, 1, "");
+    REQUIRE(document.error());
+    CHECK(document.error()->offset() < offset);
+    CHECK(!document.stats().full);
+    document.edit(early + 2, 0, ";");
+    REQUIRE(document.error());
+    CHECK(document.error()->offset() == offset);
+
+    document.edit(document.text().find("-10 }") + 3, 0, ";");
+    REQUIRE(!document.error());
+    CHECK(!document.stats().full);
+    CHECK(document.stats().reparsed <= 16);
+    CHECK(Ast::dump(document.program()) == reparsed(document));
+    check_tokens(document);
+}
+
+TEST_CASE("Document frees the nodes of replaced functions") {
+    Document document(functions(100));
+    auto initial = document.memory().used;
+    int compactions = 0;
+    for (int i = 0; i < 5000; i++) {
+        auto at = document.text().find(i % 2 ? "~(-(~50))" : "-50;");
+        document.edit(at, i % 2 ? 9 : 3, i % 2 ? "-50" : "~(-(~50))");
+        compactions += document.stats().compacted;
+        // A split function leaves the nodes of the old one behind too
+        document.edit(document.text().find("int f70"), 0, "int f(void) { "
+                                                         "return 1; } ");
+        document.edit(document.text().find("int f("),
+                      std::string_view("int f(void) { return 1; } ").size(),
+                      "");
+        compactions += document.stats().compacted;
+        CHECK(document.memory().used <=
+              COMPACT_RATIO * 2 * initial + COMPACT_MIN);
+    }
+    REQUIRE(!document.error());
+    CHECK(compactions > 0);
+    CHECK(Ast::dump(document.program()) == reparsed(document));
+}
+
+TEST_CASE("Document edits agree with a full parse") {
+    Document document(functions(20));
+    const std::pair<std::string_view, std::string_view> edits[] = {
+        {"return -3", "return ~-3"}, {"f7", "seven"},
+        {"}\nint f9", "}int f9"},    {"-12", "-(~12)"},
+        {"f19(void)", "f19( void )"}, {"int f0", "int zero"},
+    };
+    for (const auto &[from, to] : edits) {
+        auto at = document.text().find(from);
+        REQUIRE(at != std::string_view::npos);
+        document.edit(at, from.size(), to);
+        REQUIRE(!document.error());
+        CHECK(!document.stats().full);
+        CHECK(Ast::dump(document.program()) == reparsed(document));
+        check_tokens(document);
+    }
+}
+
+TEST_CASE("Document agrees with a full parse after random edits") {
+    constexpr std::string_view pieces[] = {
+        "", " ", "\n", "7", "42", "x", "~", "-", "--", "(", ")", ";",
+        " int f(void) { return 1; } ",
+    };
+    std::uint32_t seed = 12345;
+    auto next = [&](std::uint32_t bound) {
+        seed = seed * 1103515245 + 12345;
+        return (seed >> 8) % bound;
+    };
+
+    Document document(functions(8));
+    int incremental = 0;
+    for (int i = 0; i < 1000; i++) {
+        auto size = static_cast<std::uint32_t>(document.text().size());
+        auto offset = next(size + 1);
+        auto length = std::min(next(3), size - offset);
+        auto piece = pieces[next(std::size(pieces))];
+        document.edit(offset, length, piece);
+        incremental += !document.stats().full;
+
+        Arena arena{};
+        try {
+            Ast::Parser parser(document.text(), arena);
+            auto expected = Ast::dump(parser.parse());
+            REQUIRE(!document.error());
+            CHECK(Ast::dump(document.program()) == expected);
+            check_tokens(document);
+        } catch (const SyntaxError &error) {
+            REQUIRE(document.error());
+            CHECK(std::string(document.error()->what()) == error.what());
+            CHECK(document.error()->offset() == error.offset());
+        }
+        // Start over now and then, so that the text stays mostly functions
+        if (i % 100 == 99) {
+            document.edit(0, document.text().size(), functions(8));
+        }
+    }
+    CHECK(incremental > 900);
+}
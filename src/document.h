@@ -0,0 +1,103 @@
+#pragma once
+
+#include <cstddef>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include "arena.h"
+#include "lexer.h"
+#include "parser.h"
+
+// Work done by the last update of a Document
+struct EditStats {
+    std::size_t relexed{};  // tokens lexed
+    std::size_t reparsed{}; // tokens parsed
+    bool full{};            // whether everything was redone from scratch
+    bool compacted{};       // whether the arena was rebuilt to free nodes
+};
+
+// Source text kept lexed and parsed across edits, for editors and other
+// clients that re-check a file after every change. An edit relexes from
+// just before it until the new tokens line up with the old ones again, then
+// reparses only the statement or functions those tokens fall in and splices
+// the result into the tree, so lexing and parsing cost tracks the size of
+// the edit. An edit that changes the length of the text still moves what
+// follows it, which is linear but only copies memory.
+//
+// Every "int" starts a new extent of tokens, which holds one function when
+// it parses. A syntax error is kept with its extent, so while a file is
+// broken edits elsewhere stay incremental, and error() reports what a full
+// parse would. Nodes of replaced functions stay in the document's arena
+// until they outgrow the live ones by a constant factor; the live extents
+// are then parsed again into a fresh arena.
+class Document {
+    // Tokens [begin, end): an "int" and the tokens up to the next one, or
+    // whatever precedes the first "int"
+    struct Extent {
+        std::size_t begin{};
+        std::size_t end{};
+        bool parsed{}; // whether its function was built
+        // Why the tokens are not one function, and the offending token
+        // relative to `begin`; a full parse may read one token past `end`
+        std::optional<std::string> error{};
+        std::size_t error_at{};
+        std::size_t bytes{}; // arena bytes its nodes take up
+    };
+
+    std::string _text;
+    // Replaced on rebuild and compaction; an Arena cannot be reset
+    std::optional<Arena> _arena{};
+    std::size_t _live{}; // arena bytes of the extents' current nodes
+    TokenBuffer _tokens{};
+    bool _lexed{}; // false after a lexical error, which leaves no tokens
+    // One per extent; those of extents that did not parse are unused
+    std::vector<Ast::Function> _functions{};
+    std::vector<Extent> _extents{};
+    // Parsed functions per name, and extents that parsed or hold an error,
+    // so that an intact document is recognized without a scan
+    std::unordered_map<Symbol, std::size_t> _names{};
+    std::size_t _parsed{};
+    std::size_t _broken{};
+    std::optional<SyntaxError> _error{};
+    EditStats _stats{};
+
+    void rebuild();
+    bool update(std::size_t offset, std::size_t removed, std::size_t added);
+    bool reparse_statement(std::size_t extent, std::ptrdiff_t moved);
+    std::size_t reparse_extents(std::size_t lo, std::size_t hi,
+                                std::size_t first, std::size_t last);
+    Extent parse_extent(std::size_t begin, std::size_t end,
+                        Ast::Function &fn);
+    void count(const Extent &extent, const Ast::Function &fn, bool add);
+    void move_extents(std::size_t from, std::ptrdiff_t moved);
+    void compact();
+    void find_error();
+
+  public:
+    explicit Document(std::string text);
+    Document(const Document &) = delete;
+    Document &operator=(const Document &) = delete;
+
+    // Replaces `length` bytes at `offset` with `replacement`
+    void edit(std::size_t offset, std::size_t length,
+              std::string_view replacement);
+
+    [[nodiscard]] std::string_view text() const { return _text; }
+    [[nodiscard]] const TokenBuffer &tokens() const { return _tokens; }
+    [[nodiscard]] const EditStats &stats() const { return _stats; }
+    [[nodiscard]] ArenaStats memory() const { return _arena->stats(); }
+
+    // The first error in the text, as a full parse would report it
+    [[nodiscard]] const SyntaxError *error() const {
+        return _error ? &*_error : nullptr;
+    }
+
+    // Valid until the next edit, and only while there is no error
+    [[nodiscard]] Ast::Program program() const {
+        assert(!_error);
+        return Ast::Program{_functions};
+    }
+};
@@ -0,0 +1,139 @@
+#include <cstdint>
+#include <limits>
+#include <memory_resource>
+#include <vector>
+
+#include "doctest.h"
+#include "fold.h"
+#include "parser.h"
+
+namespace Ast {
+namespace {
+// Applies `ops`, innermost first, to a constant of type T. Unsigned
+// arithmetic gives the wraparound without overflowing.
+template <typename T>
+std::int64_t evaluate(T value, const std::vector<UnaryOperator> &ops) {
+    using Bits = std::make_unsigned_t<T>;
+    for (auto op : ops) {
+        switch (op) {
+        case UnaryOperator::Complement:
+            value = static_cast<T>(~static_cast<Bits>(value));
+            break;
+        case UnaryOperator::Negate:
+            value = static_cast<T>(Bits{0} - static_cast<Bits>(value));
+            break;
+        }
+    }
+    return value;
+}
+} // namespace
+
+// Unary chains are walked iteratively, since they can be nested far deeper
+// than the native stack allows
+const Exp *fold(const Exp *exp, Arena &arena) {
+    const Exp *leaf = exp;
+    std::size_t depth{};
+    while (leaf->is(Exp::Kind::Unary)) {
+        leaf = leaf->unary().exp;
+        depth++;
+    }
+    if (depth == 0) {
+        return exp;
+    }
+
+    // Operators innermost first, with adjacent equal pairs cancelled
+    std::vector<UnaryOperator> ops(depth);
+    for (auto *node = exp; node != leaf; node = node->unary().exp) {
+        ops[--depth] = node->unary().op;
+    }
+    std::vector<UnaryOperator> reduced{};
+    for (auto op : ops) {
+        if (!reduced.empty() && reduced.back() == op) {
+            reduced.pop_back();
+        } else {
+            reduced.push_back(op);
+        }
+    }
+
+    if (leaf->is(Exp::Kind::Constant)) {
+        auto value = leaf->constant().value;
+        auto folded = value <= std::numeric_limits<std::int32_t>::max()
+                          ? evaluate(static_cast<std::int32_t>(value), reduced)
+                          : evaluate(value, reduced);
+        return arena.make<Exp>(Exp::Constant{folded});
+    }
+    if (reduced.size() == ops.size()) {
+        return exp;
+    }
+    for (auto op : reduced) {
+        leaf = arena.make<Exp>(Exp::Unary{op, leaf});
+    }
+    return leaf;
+}
+
+Function fold(const Function &fn, Arena &arena) {
+    return Function{fn.name, Return{fold(fn.body.exp, arena)}};
+}
+
+Program fold(const Program &program, Arena &arena) {
+    std::pmr::vector<Function> functions(&arena);
+    functions.reserve(program.functions.size());
+    for (const auto &fn : program.functions) {
+        functions.push_back(fold(fn, arena));
+    }
+    return Program{arena.adopt(functions)};
+}
+} // namespace Ast
+
+//// TESTS ////
+
+namespace {
+std::string folded(std::string_view source) {
+    Arena arena{};
+    Ast::Parser parser(source, arena);
+    return Ast::dump(*Ast::fold(parser.parse_exp(), arena));
+}
+} // namespace
+
+TEST_CASE("fold evaluates constant unary chains") {
+    CHECK(folded("~(-(~(-5)))") == "Constant(3)");
+    CHECK(folded("-(5)") == "Constant(-5)");
+    CHECK(folded("~0") == "Constant(-1)");
+    CHECK(folded("42") == "Constant(42)");
+}
+
+TEST_CASE("fold wraps at the width of int") {
+    // ~2147483647 is INT_MIN, and negating it wraps back to INT_MIN
+    CHECK(folded("~2147483647") == "Constant(-2147483648)");
+    CHECK(folded("-(~2147483647)") == "Constant(-2147483648)");
+    CHECK(folded("~(-(~2147483647))") == "Constant(2147483647)");
+    // 2147483648 does not fit an int, so it is a long
+    CHECK(folded("-2147483648") == "Constant(-2147483648)");
+    CHECK(folded("-(~9223372036854775807)") ==
+          "Constant(-9223372036854775808)");
+}
+
+TEST_CASE("fold cancels double negation and complement") {
+    CHECK(folded("-(-7)") == "Constant(7)");
+    CHECK(folded("~~7") == "Constant(7)");
+    CHECK(folded("-~~-7") == "Constant(7)");
+    CHECK(folded("~-(-~-7)") == "Constant(-7)");
+}
+
+TEST_CASE("fold handles deep chains without recursion") {
+    std::string source(200000, '~');
+    source += "1";
+    // An even number of complements cancels out
+    CHECK(folded(source) == "Constant(1)");
+}
+
+TEST_CASE("fold rebuilds each function of a program") {
+    Arena arena{};
+    Ast::Parser parser("int one(void) { return -(-1); }\n"
+                       "int main(void) { return ~(-(~(-5))); }",
+                       arena);
+    auto program = Ast::fold(parser.parse(), arena);
+    CHECK(Ast::dump(program) ==
+          "Program([Function(one, Return(Constant(1))), "
+          "Function(main, Return(Constant(3)))])");
+}
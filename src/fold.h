@@ -0,0 +1,15 @@
+#pragma once
+
+#include "arena.h"
+#include "ast_nodes.h"
+
+namespace Ast {
+// Folds constant subexpressions with the semantics of C integers: a literal
+// up to INT_MAX is an `int` and wider ones are `long`, and arithmetic wraps
+// in two's complement at that width, so -INT_MIN is INT_MIN. Also cancels
+// -(-x) and ~~x whatever x is. New nodes are allocated in `arena`; unchanged
+// subtrees are shared with the input.
+const Exp *fold(const Exp *, Arena &);
+Function fold(const Function &, Arena &);
+Program fold(const Program &, Arena &);
+} // namespace Ast
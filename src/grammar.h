@@ -0,0 +1,73 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <string_view>
+
+#include "lexer.h"
+
+// Building blocks for the LL(1) tables that tools/llgen.cpp generates from
+// grammar.ebnf into grammar_table.h
+namespace Grammar {
+// A terminal is identified by its TokenKind, a nonterminal by its index
+struct Symbol {
+    bool terminal{};
+    std::uint8_t id{};
+};
+
+constexpr Symbol token(TokenKind kind) {
+    return {true, static_cast<std::uint8_t>(kind)};
+}
+
+template <typename Nonterminal> constexpr Symbol rule(Nonterminal nonterminal) {
+    return {false, static_cast<std::uint8_t>(nonterminal)};
+}
+
+// Token kind of a quoted terminal
+constexpr TokenKind terminal(std::string_view spelling) {
+    auto kind = lookup_reserved(spelling);
+    if (kind == TokenKind::Unknown) {
+        throw "grammar.ebnf: terminal missing from RESERVED_STRINGS";
+    }
+    return kind;
+}
+
+// Token kind of a rule defined by a special sequence, such as <identifier>
+constexpr TokenKind token_class(std::string_view rule) {
+    if (rule == "identifier") {
+        return TokenKind::Identifier;
+    }
+    if (rule == "int") {
+        return TokenKind::Integer;
+    }
+    throw "grammar.ebnf: special sequence without a token class";
+}
+
+template <typename Nonterminal, typename Production> struct TableEntry {
+    Nonterminal nonterminal{};
+    TokenKind token{};
+    Production production{};
+};
+
+// Marks parse table cells with no production: a syntax error
+constexpr std::uint8_t NO_PRODUCTION = 0xFF;
+
+// Every token kind is reserved except the ones below it
+static_assert(static_cast<std::size_t>(TokenKind::Integer) < RESERVED_COUNT);
+
+// Expands table entries into one row of production numbers per
+// nonterminal, indexed by TokenKind
+template <std::size_t Rows, typename Entry, std::size_t N>
+constexpr auto dense_table(const std::array<Entry, N> &entries) {
+    std::array<std::array<std::uint8_t, RESERVED_COUNT>, Rows> table{};
+    for (auto &row : table) {
+        row.fill(NO_PRODUCTION);
+    }
+    for (const auto &entry : entries) {
+        table[static_cast<std::size_t>(entry.nonterminal)]
+             [static_cast<std::size_t>(entry.token)] =
+                 static_cast<std::uint8_t>(entry.production);
+    }
+    return table;
+}
+} // namespace Grammar
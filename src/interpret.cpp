@@ -0,0 +1,111 @@
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "doctest.h"
+#include "fold.h"
+#include "interpret.h"
+#include "optimize.h"
+#include "ssa.h"
+
+namespace Tacky {
+// Unsigned arithmetic wraps without overflowing
+std::int32_t apply(UnaryOperator op, std::int64_t value) {
+    auto bits = static_cast<std::uint32_t>(value);
+    bits = op == UnaryOperator::Complement ? ~bits : 0u - bits;
+    return static_cast<std::int32_t>(bits);
+}
+
+std::int32_t run(const Function &fn) {
+    // Lowering never reads a register before assigning it, so their
+    // initial value does not matter
+    std::vector<std::int64_t> registers(fn.registers);
+    auto read = [&](Val val) {
+        return is_constant(val) ? constant(fn, val)
+                                : registers[index(val)];
+    };
+    for (const auto &instr : fn.body) {
+        if (instr.is(Instruction::Kind::Return)) {
+            return static_cast<std::int32_t>(read(instr.return_().val));
+        }
+        const auto &unary = instr.unary();
+        registers[index(unary.dst)] = apply(unary.op, read(unary.src));
+    }
+    return 0;
+}
+} // namespace Tacky
+
+//// TESTS ////
+
+namespace {
+// The AST of main in `source`, found by name as the driver finds it
+Ast::Function main_of(std::string_view source, Arena &arena) {
+    Ast::Parser parser(source, arena);
+    for (const auto &fn : parser.parse().functions) {
+        if (fn.name == intern("main")) {
+            return fn;
+        }
+    }
+    FAIL("no main function");
+    return {};
+}
+
+// Runs main of `source` after the same steps as the compiler
+std::int32_t result(std::string_view source, bool fold = true) {
+    Arena arena{};
+    auto ast = main_of(source, arena);
+    Tacky::Generator gen(arena);
+    auto fn = gen.convert_function(fold ? Ast::fold(ast, arena) : ast);
+    Tacky::PassStats stats{};
+    return Tacky::run(Tacky::from_ssa(Tacky::optimize(fn, arena, stats),
+                                      arena));
+}
+
+std::int32_t unoptimized(std::string_view source) {
+    Arena arena{};
+    Tacky::Generator gen(arena);
+    return Tacky::run(gen.convert_function(main_of(source, arena)));
+}
+} // namespace
+
+TEST_CASE("run evaluates unary chains with int semantics") {
+    CHECK(result("int main(void) { return 42; }") == 42);
+    CHECK(result("int main(void) { return ~(-(~(-5))); }") == 3);
+    CHECK(result("int main(void) { return -2147483647; }") == -2147483647);
+    CHECK(result("int main(void) { return -(~2147483647); }") ==
+          -2147483648);
+}
+
+TEST_CASE("run agrees with and without folding and optimization") {
+    for (auto source : {"int main(void) { return ~(-(~(-(~2147483647)))); }",
+                        "int main(void) { return -(-(-(-7))); }",
+                        "int main(void) { return ~~~0; }",
+                        "int main(void) { return -(-2147483648); }",
+                        "int main(void) { return -9223372036854775807; }"}) {
+        CAPTURE(source);
+        CHECK(unoptimized(source) == result(source));
+        CHECK(unoptimized(source) == result(source, false));
+    }
+}
+
+TEST_CASE("run finds main among other functions") {
+    constexpr auto source = "int main(void) { return -3; }\n"
+                            "int other(void) { return 9; }";
+    CHECK(result(source) == -3);
+    CHECK(unoptimized(source) == -3);
+}
+
+TEST_CASE("run reads registers and the constant pool") {
+    using Tacky::Instruction;
+    using Tacky::reg;
+    std::vector<Instruction> body{
+        Instruction::Unary{Tacky::UnaryOperator::Negate, Tacky::pooled(0),
+                           reg(0)},
+        Instruction::Unary{Tacky::UnaryOperator::Complement, reg(0), reg(1)},
+        Instruction::Return{reg(1)},
+        Instruction::Return{reg(0)},
+    };
+    std::vector<std::int64_t> constants{7};
+    CHECK(Tacky::run({intern("f"), body, constants, 2}) == 6);
+    CHECK(Tacky::run({intern("f"), {}, {}, 0}) == 0);
+}
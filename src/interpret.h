@@ -0,0 +1,16 @@
+#pragma once
+
+#include <cstdint>
+
+#include "tacky.h"
+
+namespace Tacky {
+// `op` applied to `value` as the emitted code computes it: the operand is
+// truncated to 32 bits as movl does, and the result wraps
+std::int32_t apply(UnaryOperator op, std::int64_t value);
+
+// Runs `fn` and returns the int it returns, or 0 if it ends without
+// returning, as main may. Saves assembling, linking and spawning a process
+// when only the result of a program is wanted.
+std::int32_t run(const Function &fn);
+} // namespace Tacky
@@ -1,197 +1,628 @@
 #include <algorithm>
-#include <cctype>
+#include <charconv>
 #include <format>
-#include <iostream>
+#include <future>
 #include <sstream>
-#include <stdexcept>
+#include <string>
+#include <vector>
 
+#include "arena.h"
 #include "doctest.h"
 #include "lexer.h"
+#include "scan.h"
 
-[[nodiscard]] constexpr Reserved lookup_reserved(std::string_view keyword) {
-    auto it = std::find_if(
-        RESERVED_STRINGS.begin(), RESERVED_STRINGS.end(),
-        [keyword](const auto &pair) { return pair.second == keyword; });
-
-    if (it != RESERVED_STRINGS.end())
-        return it->first;
-    return Reserved::Unknown;
-}
-
-enum class State { Start, Identifier, Integer, Hyphen };
-
-std::vector<Token> tokenize(std::istream &stream) {
-    std::string buffer{};
-    std::vector<Token> tokens{};
-    State state{};
-    char ch;
-
-    while (stream.get(ch)) {
-        switch (state) {
-        case State::Start:
-            if (std::isalpha(ch) || ch == '_') {
-                buffer.push_back(ch);
-                state = State::Identifier;
-            } else if (std::isdigit(ch)) {
-                buffer.push_back(ch);
-                state = State::Integer;
-            } else if (ch == '-') {
-                state = State::Hyphen;
-                buffer.push_back(ch);
-            } else if (std::isspace(ch)) {
-                // ignore
-            } else {
-                std::string kw(1, ch);
-                tokens.emplace_back(lookup_reserved(kw));
-            }
-            break;
+std::string_view Token::text(std::string_view source) const {
+    if (kind == TokenKind::Identifier) {
+        return symbol().to_str();
+    }
+    assert(kind == TokenKind::Integer);
+    return source.substr(offset, Scan::digits_end(source, offset) - offset);
+}
 
-        case State::Identifier:
-            if (std::isalnum(ch) || ch == '_') {
-                buffer.push_back(ch);
-            } else {
-                auto reserved = lookup_reserved(buffer);
-                if (reserved == Reserved::Unknown) {
-                    tokens.emplace_back(Identifier{buffer});
-                } else {
-                    tokens.emplace_back(reserved);
-                }
-                buffer.clear();
-                state = State::Start;
-                stream.putback(ch);
-            }
-            break;
+Lexer::Lexer(std::string_view source) : _source(source) {
+    if (source.size() > UINT32_MAX) {
+        throw SyntaxError("Source files larger than 4 GiB are not supported");
+    }
+}
 
-        case State::Integer:
-            if (std::isdigit(ch)) {
-                buffer.push_back(ch);
-            } else {
-                tokens.emplace_back(Integer{buffer});
-                buffer.clear();
-                state = State::Start;
-                stream.putback(ch);
-            }
-            break;
+Lexer::Lexer(SourceStream &stream)
+    : _source(stream.window()), _stream(&stream), _base(stream.base()) {}
 
-        case State::Hyphen:
-            if (ch == '-') {
-                tokens.emplace_back(Reserved::Decrement);
-                state = State::Start;
-            } else {
-                tokens.emplace_back(Reserved::Negate);
-                state = State::Start;
-                buffer.clear();
-                stream.putback(ch);
-            }
-            break;
+// Slides the stream window past consumed input and reads more. Returns false
+// when there was nothing left to read.
+bool Lexer::refill() {
+    if (!_stream || _stream->exhausted()) {
+        return false;
+    }
+    auto consumed = std::min(_previous, _pos);
+    auto full = _source.size() == _stream->capacity();
+    if (consumed == 0 && full) {
+        // Give up the previous token to make room
+        consumed = _pos;
+        if (consumed == 0) {
+            throw SyntaxError(
+                std::format("Token does not fit in the {} byte stream buffer",
+                            _stream->capacity()),
+                offset(_pos));
+        }
+    }
 
-        default:
-            throw SyntaxError("Unknown state");
+    auto read = _stream->refill(consumed);
+    _source = _stream->window();
+    _base = _stream->base();
+    _pos -= consumed;
+    _previous = _previous > consumed ? _previous - consumed : 0;
+    if (_base + _source.size() > UINT32_MAX) {
+        throw SyntaxError("Source files larger than 4 GiB are not supported");
+    }
+    return read > 0;
+}
+
+Token Lexer::next() {
+    _pos = Scan::skip_whitespace(_source, _pos);
+    while (_pos == _source.size() && refill()) {
+        _pos = Scan::skip_whitespace(_source, _pos);
+    }
+    if (_pos >= _source.size()) {
+        return {TokenKind::Eof, offset(_source.size())};
+    }
+
+    auto match = LEXER_DFA.longest_match(_source, _pos);
+    // A token running into the end of a stream window may continue past it
+    while (match.truncated && refill()) {
+        match = LEXER_DFA.longest_match(_source, _pos);
+    }
+
+    auto start = _pos;
+    _previous = start;
+    Token token{match.kind, offset(start)};
+    if (match.kind == TokenKind::Unknown) {
+        // Stray byte: report it alone and keep going
+        match.length = 1;
+    }
+    _pos += match.length;
+
+    if (match.kind == TokenKind::Identifier) {
+        auto word = _source.substr(start, match.length);
+        token.kind = lookup_reserved(word);
+        if (token.kind == TokenKind::Unknown) {
+            token = {TokenKind::Identifier, offset(start), intern(word).id()};
         }
+    } else if (match.kind == TokenKind::Integer) {
+        auto digits = _source.substr(start, match.length);
+        std::int64_t value{};
+        auto result = std::from_chars(digits.data(),
+                                      digits.data() + digits.size(), value);
+        if (result.ec == std::errc::result_out_of_range) {
+            throw SyntaxError(
+                std::format("Integer literal {} is too large", digits),
+                offset(start));
+        }
+        token.payload = _integers.encode(value);
     }
+    return token;
+}
+
+void Lexer::print(std::ostream &out, Token token) const {
+    if (!token.is(TokenKind::Integer)) {
+        out << token.to_str(_source);
+    } else if (token.offset < _base) {
+        out << value(token);
+    } else {
+        token.offset -= static_cast<std::uint32_t>(_base);
+        out << token.text(_source);
+    }
+}
 
-    if (!buffer.empty()) {
-        if (state == State::Integer) {
-            tokens.emplace_back(Integer{buffer});
-        } else if (state == State::Identifier) {
-            tokens.emplace_back(Identifier{buffer});
-        } else if (state == State::Hyphen) {
-            tokens.emplace_back(Reserved::Negate);
+std::string Lexer::to_str(Token token) const {
+    std::ostringstream out{};
+    print(out, token);
+    return out.str();
+}
+
+void TokenBuffer::append(const TokenBuffer &part, std::uint32_t base) {
+    auto start = size();
+    _kinds.insert(_kinds.end(), part._kinds.begin(), part._kinds.end());
+    _offsets.reserve(start + part.size());
+    for (auto offset : part._offsets) {
+        _offsets.push_back(base + offset);
+    }
+    _payloads.insert(_payloads.end(), part._payloads.begin(),
+                     part._payloads.end());
+
+    // Integer payloads may index the part's out-of-line values
+    for (std::size_t i = 0; i < part.size(); i++) {
+        if (part._kinds[i] == TokenKind::Integer) {
+            _payloads[start + i] = _integers.encode(part.value(i));
+        }
+    }
+}
+
+void TokenBuffer::splice(std::string_view source, std::size_t first,
+                         std::size_t last, const TokenBuffer &part,
+                         std::uint32_t base, std::int64_t shift) {
+    assert(first <= last && last <= size());
+    _source = source;
+    for (auto i = first; i < last; i++) {
+        if (_kinds[i] == TokenKind::Integer) {
+            _integers.release(_payloads[i]);
         }
     }
+    auto count = part.size();
+    // Only a change in the number of tokens moves the ones after them
+    auto resize = [&](auto &items) {
+        if (count < last - first) {
+            items.erase(items.begin() + first + count, items.begin() + last);
+        } else {
+            items.insert(items.begin() + last, first + count - last, {});
+        }
+    };
+    resize(_kinds);
+    resize(_offsets);
+    resize(_payloads);
+    std::copy(part._kinds.begin(), part._kinds.end(), _kinds.begin() + first);
+    std::copy(part._payloads.begin(), part._payloads.end(),
+              _payloads.begin() + first);
+
+    for (std::size_t i = 0; i < count; i++) {
+        _offsets[first + i] = base + part._offsets[i];
+        if (part._kinds[i] == TokenKind::Integer) {
+            _payloads[first + i] = _integers.encode(part.value(i));
+        }
+    }
+    if (shift != 0) {
+        for (auto i = first + count; i < size(); i++) {
+            _offsets[i] = static_cast<std::uint32_t>(_offsets[i] + shift);
+        }
+    }
+}
 
+namespace {
+// Chunks below this size are not worth a thread
+constexpr std::size_t MIN_CHUNK_SIZE = 64 * 1024;
+
+TokenBuffer tokenize_serial(std::string_view source,
+                            std::pmr::memory_resource *resource) {
+    Lexer lexer(source);
+    TokenBuffer tokens(source, resource);
+    for (auto token = lexer.next(); !token.is(TokenKind::Eof);
+         token = lexer.next()) {
+        if (token.is(TokenKind::Integer)) {
+            tokens.push_integer(token, lexer.value(token));
+        } else {
+            tokens.push(token);
+        }
+    }
+    return tokens;
+}
+
+// Splits the source at whitespace, which is never part of a token, so no
+// token straddles two chunks. This holds while the language has no comments
+// or string literals.
+std::vector<std::size_t> chunk_boundaries(std::string_view source,
+                                          unsigned chunks) {
+    std::vector<std::size_t> boundaries{0};
+    for (unsigned i = 1; i < chunks; i++) {
+        auto pos = std::max(boundaries.back(), source.size() / chunks * i);
+        pos = std::find_if(source.begin() + pos, source.end(), Scan::is_space) -
+              source.begin();
+        if (pos == source.size()) {
+            break;
+        }
+        if (pos > boundaries.back()) {
+            boundaries.push_back(pos);
+        }
+    }
+    boundaries.push_back(source.size());
+    return boundaries;
+}
+} // namespace
+
+TokenBuffer tokenize(std::string_view source, unsigned threads,
+                     std::pmr::memory_resource *resource) {
+    auto chunks =
+        std::min<std::size_t>(threads, source.size() / MIN_CHUNK_SIZE);
+    if (chunks <= 1) {
+        return tokenize_serial(source, resource);
+    }
+    if (source.size() > UINT32_MAX) {
+        throw SyntaxError("Source files larger than 4 GiB are not supported");
+    }
+
+    auto boundaries = chunk_boundaries(source, chunks);
+    std::vector<std::future<TokenBuffer>> parts{};
+    for (std::size_t i = 0; i + 1 < boundaries.size(); i++) {
+        auto base = static_cast<std::uint32_t>(boundaries[i]);
+        auto chunk = source.substr(base, boundaries[i + 1] - base);
+        parts.push_back(std::async(std::launch::async, [chunk, base] {
+            try {
+                return tokenize_serial(chunk,
+                                       std::pmr::new_delete_resource());
+            } catch (const SyntaxError &error) {
+                if (auto offset = error.offset()) {
+                    throw SyntaxError(error.what(), base + *offset);
+                }
+                throw;
+            }
+        }));
+    }
+
+    // get() rethrows in source order, so the first error is the one reported
+    TokenBuffer tokens(source, resource);
+    for (std::size_t i = 0; i < parts.size(); i++) {
+        tokens.append(parts[i].get(),
+                      static_cast<std::uint32_t>(boundaries[i]));
+    }
     return tokens;
 }
 
 TEST_CASE("to_str works") {
-    std::stringstream source("~(-2)");
+    std::string_view source("~(-2)");
     auto tokens = tokenize(source);
-    CHECK(tokens[0].to_str() == "~");
-    CHECK(tokens[1].to_str() == "(");
-    CHECK(tokens[2].to_str() == "-");
-    CHECK(tokens[3].to_str() == "2");
-    CHECK(tokens[4].to_str() == ")");
+    CHECK(tokens.to_str(0) == "~");
+    CHECK(tokens.to_str(1) == "(");
+    CHECK(tokens.to_str(2) == "-");
+    CHECK(tokens.to_str(3) == "2");
+    CHECK(tokens.to_str(4) == ")");
 }
 
 TEST_CASE("out of order unarys") {
-    std::stringstream source("2-");
+    std::string_view source("2-");
     auto tokens = tokenize(source);
     CHECK(tokens.size() == 2);
-    CHECK(std::get<Integer>(tokens[0].value) == "2");
-    CHECK(std::get<Reserved>(tokens[1].value) == Reserved::Negate);
+    CHECK(tokens.kind(0) == TokenKind::Integer);
+    CHECK(tokens.text(0) == "2");
+    CHECK(tokens.kind(1) == TokenKind::Negate);
 }
 
 TEST_CASE("unarys with parens") {
-    std::stringstream source("~(-2)");
+    std::string_view source("~(-2)");
     auto tokens = tokenize(source);
     CHECK(tokens.size() == 5);
-    CHECK(std::get<Reserved>(tokens[0].value) == Reserved::Complement);
-    CHECK(std::get<Reserved>(tokens[1].value) == Reserved::OpenParen);
-    CHECK(std::get<Reserved>(tokens[2].value) == Reserved::Negate);
-    CHECK(std::get<Integer>(tokens[3].value) == "2");
-    CHECK(std::get<Reserved>(tokens[4].value) == Reserved::CloseParen);
+    CHECK(tokens.kind(0) == TokenKind::Complement);
+    CHECK(tokens.kind(1) == TokenKind::OpenParen);
+    CHECK(tokens.kind(2) == TokenKind::Negate);
+    CHECK(tokens.kind(3) == TokenKind::Integer);
+    CHECK(tokens.text(3) == "2");
+    CHECK(tokens.kind(4) == TokenKind::CloseParen);
 }
 
 TEST_CASE("unary stream") {
-    std::stringstream source("-~--~");
+    std::string_view source("-~--~");
     auto tokens = tokenize(source);
-    CHECK(std::get<Reserved>(tokens[0].value) == Reserved::Negate);
-    CHECK(std::get<Reserved>(tokens[1].value) == Reserved::Complement);
-    CHECK(std::get<Reserved>(tokens[2].value) == Reserved::Decrement);
-    CHECK(std::get<Reserved>(tokens[3].value) == Reserved::Complement);
+    CHECK(tokens.kind(0) == TokenKind::Negate);
+    CHECK(tokens.kind(1) == TokenKind::Complement);
+    CHECK(tokens.kind(2) == TokenKind::Decrement);
+    CHECK(tokens.kind(3) == TokenKind::Complement);
 }
 
 TEST_CASE("decrement token") {
-    std::stringstream source("--");
+    std::string_view source("--");
     auto tokens = tokenize(source);
-    CHECK(std::get<Reserved>(tokens[0].value) == Reserved::Decrement);
+    CHECK(tokens.kind(0) == TokenKind::Decrement);
 }
 
 TEST_CASE("bitwise complement token") {
-    std::stringstream source("~");
+    std::string_view source("~");
     auto tokens = tokenize(source);
-    CHECK(std::get<Reserved>(tokens[0].value) == Reserved::Complement);
+    CHECK(tokens.kind(0) == TokenKind::Complement);
 }
 
 TEST_CASE("hyphen token") {
-    std::stringstream source("-");
+    std::string_view source("-");
     auto tokens = tokenize(source);
-    CHECK(std::get<Reserved>(tokens[0].value) == Reserved::Negate);
+    CHECK(tokens.kind(0) == TokenKind::Negate);
 }
 
 TEST_CASE("identifiers can have digits") {
-    std::stringstream source("i2x6(");
+    std::string_view source("i2x6(");
     auto tokens = tokenize(source);
-    CHECK(std::get<Identifier>(tokens[0].value) == "i2x6");
-    CHECK(std::get<Reserved>(tokens[1].value) == Reserved::OpenParen);
+    CHECK(tokens.kind(0) == TokenKind::Identifier);
+    CHECK(tokens.text(0) == "i2x6");
+    CHECK(tokens.kind(1) == TokenKind::OpenParen);
 }
 
 TEST_CASE("integer token") {
-    std::stringstream source("2246;");
+    std::string_view source("2246;");
     auto tokens = tokenize(source);
-    CHECK(std::get<Integer>(tokens[0].value) == "2246");
-    CHECK(std::get<Reserved>(tokens[1].value) == Reserved::Semicolon);
+    CHECK(tokens.kind(0) == TokenKind::Integer);
+    CHECK(tokens.text(0) == "2246");
+    CHECK(tokens.kind(1) == TokenKind::Semicolon);
 }
 
 TEST_CASE("whitespace is ignored") {
-    std::stringstream source(" \n\t ;  ");
+    std::string_view source(" \n\t ;  ");
     auto tokens = tokenize(source);
     REQUIRE(tokens.size() == 1);
-    CHECK(std::get<Reserved>(tokens[0].value) == Reserved::Semicolon);
+    CHECK(tokens.kind(0) == TokenKind::Semicolon);
 }
 
 TEST_CASE("simple valid program") {
-    std::stringstream source("int \tmain(void)    {\n return 42; \n}");
+    std::string_view source("int \tmain(void)    {\n return 42; \n}");
     auto tokens = tokenize(source);
     REQUIRE(tokens.size() == 10);
-    CHECK(std::get<Reserved>(tokens[0].value) == Reserved::IntType);
-    CHECK(std::get<Identifier>(tokens[1].value) == "main");
-    CHECK(std::get<Reserved>(tokens[2].value) == Reserved::OpenParen);
-    CHECK(std::get<Reserved>(tokens[3].value) == Reserved::Void);
-    CHECK(std::get<Reserved>(tokens[4].value) == Reserved::CloseParen);
-    CHECK(std::get<Reserved>(tokens[5].value) == Reserved::OpenBrace);
-    CHECK(std::get<Reserved>(tokens[6].value) == Reserved::Return);
-    CHECK(std::get<Integer>(tokens[7].value) == "42");
-    CHECK(std::get<Reserved>(tokens[8].value) == Reserved::Semicolon);
-    CHECK(std::get<Reserved>(tokens[9].value) == Reserved::CloseBrace);
+    CHECK(tokens.kind(0) == TokenKind::IntType);
+    CHECK(tokens.kind(1) == TokenKind::Identifier);
+    CHECK(tokens.text(1) == "main");
+    CHECK(tokens.kind(2) == TokenKind::OpenParen);
+    CHECK(tokens.kind(3) == TokenKind::Void);
+    CHECK(tokens.kind(4) == TokenKind::CloseParen);
+    CHECK(tokens.kind(5) == TokenKind::OpenBrace);
+    CHECK(tokens.kind(6) == TokenKind::Return);
+    CHECK(tokens.kind(7) == TokenKind::Integer);
+    CHECK(tokens.text(7) == "42");
+    CHECK(tokens.kind(8) == TokenKind::Semicolon);
+    CHECK(tokens.kind(9) == TokenKind::CloseBrace);
+}
+
+TEST_CASE("integer tokens view into the source") {
+    std::string_view source("foo 42");
+    auto tokens = tokenize(source);
+    REQUIRE(tokens.size() == 2);
+    CHECK(tokens.kind(1) == TokenKind::Integer);
+    CHECK(tokens.text(1).data() == source.data() + 4);
+}
+
+TEST_CASE("identifier tokens are interned") {
+    auto tokens = tokenize("foo bar foo");
+    REQUIRE(tokens.size() == 3);
+    CHECK(tokens.symbol(0) == tokens.symbol(2));
+    CHECK(tokens.symbol(0) != tokens.symbol(1));
+    CHECK(tokens.text(0) == "foo");
+}
+
+TEST_CASE("reserved word at end of input") {
+    auto tokens = tokenize("return");
+    REQUIRE(tokens.size() == 1);
+    CHECK(tokens.kind(0) == TokenKind::Return);
+}
+
+TEST_CASE("long runs are lexed identically by every scanner") {
+    std::string source = std::string(70, ' ') + std::string(65, 'x') + "9 " +
+                         std::string(50, '0') + "\n\t-";
+    auto previous = Scan::current_impl();
+    for (auto impl : {Scan::Impl::Scalar, Scan::Impl::SSE2, Scan::Impl::AVX2}) {
+        Scan::use_impl(impl);
+        auto tokens = tokenize(source);
+        REQUIRE(tokens.size() == 3);
+        CHECK(tokens.kind(0) == TokenKind::Identifier);
+        CHECK(tokens.text(0).size() == 66);
+        CHECK(tokens.kind(1) == TokenKind::Integer);
+        CHECK(tokens.text(1).size() == 50);
+        CHECK(tokens[2].is(TokenKind::Negate));
+    }
+    Scan::use_impl(previous);
+}
+
+TEST_CASE("reserved lookup scales to the full C keyword and punctuator set") {
+    constexpr std::array<std::string_view, 92> spellings{
+        "auto",     "break",    "case",     "char",     "const",
+        "continue", "default",  "do",       "double",   "else",
+        "enum",     "extern",   "float",    "for",      "goto",
+        "if",       "inline",   "int",      "long",     "register",
+        "restrict", "return",   "short",    "signed",   "sizeof",
+        "static",   "struct",   "switch",   "typedef",  "union",
+        "unsigned", "void",     "volatile", "while",    "_Bool",
+        "_Complex", "_Imaginary", "_Alignas", "_Alignof", "_Atomic",
+        "_Generic", "_Noreturn", "_Static_assert", "_Thread_local",
+        "[",        "]",        "(",        ")",        "{",
+        "}",        ".",        "->",       "++",       "--",
+        "&",        "*",        "+",        "-",        "~",
+        "!",        "/",        "%",        "<<",       ">>",
+        "<",        ">",        "<=",       ">=",       "==",
+        "!=",       "^",        "|",        "&&",       "||",
+        "?",        ":",        ";",        "...",      "=",
+        "*=",       "/=",       "%=",       "+=",       "-=",
+        "<<=",      ">>=",      "&=",       "^=",       "|=",
+        ",",        "#",        "##",
+    };
+    constexpr auto entries = [&] {
+        std::array<std::pair<int, std::string_view>, spellings.size()> e{};
+        for (std::size_t i = 0; i < spellings.size(); i++) {
+            e[i] = {static_cast<int>(i), spellings[i]};
+        }
+        return e;
+    }();
+    constexpr PerfectHash<int, entries.size()> lookup{entries};
+
+    for (std::size_t i = 0; i < spellings.size(); i++) {
+        CHECK(lookup.find(spellings[i], -1) == static_cast<int>(i));
+    }
+    CHECK(lookup.find("main", -1) == -1);
+    CHECK(lookup.find("", -1) == -1);
+    CHECK(lookup.find("<<==", -1) == -1);
+}
+
+namespace {
+enum class CToken { None, Identifier, Integer, Punctuator };
+constexpr std::array<std::pair<CToken, std::string_view>, 48> C_PUNCTUATORS{{
+    {CToken::Punctuator, "["},   {CToken::Punctuator, "]"},
+    {CToken::Punctuator, "("},   {CToken::Punctuator, ")"},
+    {CToken::Punctuator, "{"},   {CToken::Punctuator, "}"},
+    {CToken::Punctuator, "."},   {CToken::Punctuator, "->"},
+    {CToken::Punctuator, "++"},  {CToken::Punctuator, "--"},
+    {CToken::Punctuator, "&"},   {CToken::Punctuator, "*"},
+    {CToken::Punctuator, "+"},   {CToken::Punctuator, "-"},
+    {CToken::Punctuator, "~"},   {CToken::Punctuator, "!"},
+    {CToken::Punctuator, "/"},   {CToken::Punctuator, "%"},
+    {CToken::Punctuator, "<<"},  {CToken::Punctuator, ">>"},
+    {CToken::Punctuator, "<"},   {CToken::Punctuator, ">"},
+    {CToken::Punctuator, "<="},  {CToken::Punctuator, ">="},
+    {CToken::Punctuator, "=="},  {CToken::Punctuator, "!="},
+    {CToken::Punctuator, "^"},   {CToken::Punctuator, "|"},
+    {CToken::Punctuator, "&&"},  {CToken::Punctuator, "||"},
+    {CToken::Punctuator, "?"},   {CToken::Punctuator, ":"},
+    {CToken::Punctuator, ";"},   {CToken::Punctuator, "..."},
+    {CToken::Punctuator, "="},   {CToken::Punctuator, "*="},
+    {CToken::Punctuator, "/="},  {CToken::Punctuator, "%="},
+    {CToken::Punctuator, "+="},  {CToken::Punctuator, "-="},
+    {CToken::Punctuator, "<<="}, {CToken::Punctuator, ">>="},
+    {CToken::Punctuator, "&="},  {CToken::Punctuator, "^="},
+    {CToken::Punctuator, "|="},  {CToken::Punctuator, ","},
+    {CToken::Punctuator, "#"},   {CToken::Punctuator, "##"},
+}};
+} // namespace
+
+TEST_CASE("lexer DFA takes the longest punctuator") {
+    constexpr auto dfa = make_lexer_dfa<C_PUNCTUATORS>(CToken::Identifier,
+                                                       CToken::Integer);
+    auto split = [&](std::string_view source) {
+        std::vector<std::string_view> parts{};
+        for (auto pos = Scan::skip_whitespace(source, 0); pos < source.size();
+             pos = Scan::skip_whitespace(source, pos)) {
+            auto match = dfa.longest_match(source, pos);
+            REQUIRE(match.kind != CToken::None);
+            parts.push_back(source.substr(pos, match.length));
+            pos += match.length;
+        }
+        return parts;
+    };
+
+    using Parts = std::vector<std::string_view>;
+    CHECK(split("a->b") == Parts{"a", "->", "b"});
+    CHECK(split("x<<=1") == Parts{"x", "<<=", "1"});
+    CHECK(split("x<<1") == Parts{"x", "<<", "1"});
+    CHECK(split("f(...)") == Parts{"f", "(", "...", ")"});
+    // ".." is not a token, so the automaton backs off to "."
+    CHECK(split("a..b") == Parts{"a", ".", ".", "b"});
+    CHECK(split("i+++j") == Parts{"i", "++", "+", "j"});
+    CHECK(split("12ab") == Parts{"12", "ab"});
+    CHECK(dfa.longest_match("@", 0).kind == CToken::None);
+}
+
+TEST_CASE("lexer DFA agrees with the reserved spellings") {
+    for (const auto &[token, spelling] : RESERVED_STRINGS) {
+        auto match = LEXER_DFA.longest_match(spelling, 0);
+        CHECK(match.length == spelling.size());
+        // Keywords come back as identifiers for lookup_reserved to resolve
+        CHECK((match.kind == token || match.kind == TokenKind::Identifier));
+    }
+}
+
+TEST_CASE("reserved_string is the inverse of lookup_reserved") {
+    for (const auto &[token, spelling] : RESERVED_STRINGS) {
+        CHECK(lookup_reserved(spelling) == token);
+        CHECK(reserved_string(token) == spelling);
+    }
+    CHECK(reserved_string(TokenKind::Unknown) == "Unknown Keyword");
+}
+
+TEST_CASE("tokens record their source offsets") {
+    auto tokens = tokenize("int  main -- 42");
+    REQUIRE(tokens.size() == 4);
+    CHECK(tokens[0].offset == 0);
+    CHECK(tokens[1].offset == 5);
+    CHECK(tokens.symbol(1) == intern("main"));
+    CHECK(tokens[2].offset == 10);
+    CHECK(tokens[3].offset == 13);
+    CHECK(tokens[3].payload == 42);
+    static_assert(sizeof(TokenKind) == 1);
+}
+
+TEST_CASE("Lexer produces tokens on demand") {
+    Lexer lexer("return 42;");
+    CHECK(lexer.next().is(TokenKind::Return));
+    auto integer = lexer.next();
+    CHECK(integer.is(TokenKind::Integer));
+    CHECK(integer.text(lexer.source()) == "42");
+    CHECK(lexer.next().is(TokenKind::Semicolon));
+    CHECK(lexer.next().is(TokenKind::Eof));
+    CHECK(lexer.next().is(TokenKind::Eof));
+}
+
+TEST_CASE("integer literals are converted at lex time") {
+    auto tokens = tokenize("0 007 2147483647 2147483648 9223372036854775807");
+    REQUIRE(tokens.size() == 5);
+    CHECK(tokens.value(0) == 0);
+    CHECK(tokens.value(1) == 7);
+    CHECK(tokens.text(1) == "007");
+    CHECK(tokens.value(2) == 2147483647);
+    CHECK(tokens.value(3) == 2147483648);
+    CHECK(tokens.value(4) == INT64_MAX);
+    CHECK(tokens.text(4) == "9223372036854775807");
+}
+
+TEST_CASE("integer literals that overflow are diagnosed") {
+    REQUIRE_THROWS_WITH_AS(
+        tokenize("return 9223372036854775808;"),
+        "Integer literal 9223372036854775808 is too large", SyntaxError);
+}
+
+TEST_CASE("parallel lexing matches the serial lexer") {
+    std::string source{};
+    while (source.size() < 1024 * 1024) {
+        source += "int main(void) {\n    return ~(-(--identifier_x42 "
+                  "9223372036854775807 2147483648 17)); }\n";
+    }
+
+    auto serial = tokenize(source);
+    for (unsigned threads : {2u, 3u, 8u}) {
+        auto parallel = tokenize(source, threads);
+        REQUIRE(parallel.size() == serial.size());
+        std::size_t mismatches{0};
+        for (std::size_t i = 0; i < serial.size(); i++) {
+            bool same = parallel.kind(i) == serial.kind(i) &&
+                        parallel[i].offset == serial[i].offset;
+            if (same && serial.kind(i) == TokenKind::Integer) {
+                same = parallel.value(i) == serial.value(i);
+            } else if (same) {
+                same = parallel[i].payload == serial[i].payload;
+            }
+            mismatches += !same;
+        }
+        CHECK(mismatches == 0);
+    }
+}
+
+TEST_CASE("tokenize allocates the token arrays from the given arena") {
+    std::string source(256 * 1024, ' ');
+    source += "int main(void) { return 2147483648; }";
+    for (unsigned threads : {1u, 4u}) {
+        Arena arena(1024);
+        auto tokens = tokenize(source, threads, &arena);
+        REQUIRE(tokens.size() == 10);
+        CHECK(tokens.value(7) == 2147483648);
+
+        // 9 bytes per token plus the out-of-line value, at least
+        auto stats = arena.stats();
+        CHECK(stats.used >= 9 * tokens.size() + sizeof(std::int64_t));
+        CHECK(stats.reserved >= stats.used);
+    }
+}
+
+TEST_CASE("TokenBuffer::splice replaces a run of tokens and moves the rest") {
+    std::string before = "return 1 ; x";
+    std::string after = "return ~3000000000 ; x";
+    auto tokens = tokenize(before);
+    // "1" at offset 7 became "~3000000000"
+    auto part = tokenize(std::string_view(after).substr(7, 11));
+    tokens.splice(after, 1, 2, part, 7, 10);
+
+    auto fresh = tokenize(after);
+    REQUIRE(tokens.size() == fresh.size());
+    for (std::size_t i = 0; i < fresh.size(); i++) {
+        CHECK(tokens[i].kind == fresh[i].kind);
+        CHECK(tokens[i].offset == fresh[i].offset);
+        CHECK(tokens.to_str(i) == fresh.to_str(i));
+    }
+    CHECK(tokens.value(2) == 3000000000);
+    CHECK(tokens.source() == after);
+
+    // Replacing the wide literal again reuses its slot
+    for (int i = 0; i < 100; i++) {
+        tokens.splice(after, 2, 3, tokenize("3000000000"), 8, 0);
+    }
+    CHECK(tokens.integers().size() == 1);
+    CHECK(tokens.value(2) == 3000000000);
+}
+
+TEST_CASE("parallel lexing reports errors at source offsets") {
+    std::string source(512 * 1024, ' ');
+    source += "99999999999999999999";
+    REQUIRE_THROWS_AS(tokenize(source, 4), SyntaxError);
+    try {
+        tokenize(source, 4);
+    } catch (const SyntaxError &error) {
+        CHECK(error.offset() == 512u * 1024);
+    }
 }
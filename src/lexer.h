@@ -3,17 +3,28 @@
 #include <algorithm>
 #include <array>
 #include <cassert>
+#include <cstdint>
 #include <exception>
-#include <fstream>
-#include <map>
+#include <memory_resource>
+#include <optional>
+#include <ostream>
 #include <string>
 #include <string_view>
-#include <variant>
 #include <vector>
 
-// ignored: whitespace, newlines, eof
-enum class Reserved {
+#include "dfa.h"
+#include "perfect_hash.h"
+#include "stream.h"
+#include "symbol.h"
+
+// ignored: whitespace, newlines
+enum class TokenKind : std::uint8_t {
     Unknown,
+    Eof,
+
+    // Containers, whose payload locates their text
+    Identifier,
+    Integer,
 
     // Keywords
     IntType,
@@ -31,76 +42,274 @@ enum class Reserved {
     Complement,
 };
 
-// Container tokens
-struct Identifier : std::string {};
-struct Integer : std::string {};
-
-constexpr std::array<std::pair<Reserved, std::string_view>, 11>
+constexpr std::array<std::pair<TokenKind, std::string_view>, 11>
     RESERVED_STRINGS{{
-        {Reserved::IntType, "int"},
-        {Reserved::Void, "void"},
-        {Reserved::Return, "return"},
-        {Reserved::OpenParen, "("},
-        {Reserved::CloseParen, ")"},
-        {Reserved::OpenBrace, "{"},
-        {Reserved::CloseBrace, "}"},
-        {Reserved::Semicolon, ";"},
-        {Reserved::Negate, "-"},
-        {Reserved::Decrement, "--"},
-        {Reserved::Complement, "~"},
+        {TokenKind::IntType, "int"},
+        {TokenKind::Void, "void"},
+        {TokenKind::Return, "return"},
+        {TokenKind::OpenParen, "("},
+        {TokenKind::CloseParen, ")"},
+        {TokenKind::OpenBrace, "{"},
+        {TokenKind::CloseBrace, "}"},
+        {TokenKind::Semicolon, ";"},
+        {TokenKind::Negate, "-"},
+        {TokenKind::Decrement, "--"},
+        {TokenKind::Complement, "~"},
     }};
 
-[[nodiscard]] constexpr std::string_view reserved_string(Reserved token) {
-    auto it =
-        std::find_if(RESERVED_STRINGS.begin(), RESERVED_STRINGS.end(),
-                     [token](const auto &pair) { return pair.first == token; });
-    return it != RESERVED_STRINGS.end() ? it->second : "Unknown Keyword";
+constexpr PerfectHash<TokenKind, RESERVED_STRINGS.size()>
+    RESERVED_LOOKUP{RESERVED_STRINGS};
+
+[[nodiscard]] constexpr TokenKind lookup_reserved(std::string_view spelling) {
+    return RESERVED_LOOKUP.find(spelling, TokenKind::Unknown);
 }
 
-template <typename... Ts> struct overloaded : Ts... {
-    using Ts::operator()...; // Inherit operator() from all base classes
-};
+constexpr std::size_t RESERVED_COUNT = [] {
+    std::size_t count{0};
+    for (const auto &[token, _] : RESERVED_STRINGS) {
+        count = std::max(count, static_cast<std::size_t>(token) + 1);
+    }
+    return count;
+}();
+
+// Spellings indexed by TokenKind, the inverse of RESERVED_LOOKUP
+constexpr auto RESERVED_SPELLINGS = [] {
+    std::array<std::string_view, RESERVED_COUNT> spellings{};
+    spellings.fill("Unknown Keyword");
+    for (const auto &[token, spelling] : RESERVED_STRINGS) {
+        spellings[static_cast<std::size_t>(token)] = spelling;
+    }
+    return spellings;
+}();
 
-// Deduction guide to infer template arguments
-template <typename... Ts> overloaded(Ts...) -> overloaded<Ts...>;
+[[nodiscard]] constexpr std::string_view reserved_string(TokenKind token) {
+    auto index = static_cast<std::size_t>(token);
+    return index < RESERVED_SPELLINGS.size() ? RESERVED_SPELLINGS[index]
+                                             : "Unknown Keyword";
+}
 
-using TokenType = std::variant<Reserved, Identifier, Integer>;
+static_assert(lookup_reserved("return") == TokenKind::Return);
+static_assert(lookup_reserved("--") == TokenKind::Decrement);
+static_assert(lookup_reserved("main") == TokenKind::Unknown);
+static_assert(reserved_string(TokenKind::Complement) == "~");
 
-struct Token {
-    // Use class with constructors for better type safety?
-    TokenType value{};
+// Token automaton; a new punctuator only needs its RESERVED_STRINGS entry
+constexpr auto LEXER_DFA = make_lexer_dfa<RESERVED_STRINGS>(
+    TokenKind::Identifier, TokenKind::Integer);
+
+static_assert(LEXER_DFA.accepts(LEXER_DFA.step(
+                  LEXER_DFA.step(LEXER_DFA.START, '-'), '-')) ==
+              TokenKind::Decrement);
+
+// Integer token payloads hold values below 2^31 directly. Larger values are
+// kept out of line by whoever produced the token, and the payload indexes them
+// with the top bit set. Slots given back with release() are reused, so
+// replacing tokens does not grow the pool.
+class IntegerPool {
+    static constexpr std::uint32_t WIDE = 0x8000'0000;
+    std::pmr::vector<std::int64_t> _wide;
+    std::pmr::vector<std::uint32_t> _free;
 
-    [[nodiscard]] bool is(Reserved token) const noexcept {
-        return is<Reserved>() && get_value<Reserved>() == token;
+  public:
+    explicit IntegerPool(std::pmr::memory_resource *resource =
+                             std::pmr::get_default_resource())
+        : _wide(resource), _free(resource) {}
+
+    [[nodiscard]] std::uint32_t encode(std::int64_t value) {
+        if (value >= 0 && value < WIDE) {
+            return static_cast<std::uint32_t>(value);
+        }
+        if (!_free.empty()) {
+            auto slot = _free.back();
+            _free.pop_back();
+            _wide[slot] = value;
+            return WIDE | slot;
+        }
+        _wide.push_back(value);
+        return WIDE | static_cast<std::uint32_t>(_wide.size() - 1);
     }
 
-    template <typename T> [[nodiscard]] bool is() const noexcept {
-        return std::holds_alternative<T>(value);
+    // The token encoded as `payload` is gone
+    void release(std::uint32_t payload) {
+        if (payload & WIDE) {
+            _free.push_back(payload & ~WIDE);
+        }
     }
 
-    template <typename T> [[nodiscard]] const T &get_value() const noexcept {
-        assert(is<T>()); // TODO: disable in release build
-        return std::get<T>(value);
+    // Values held out of line, including released slots
+    [[nodiscard]] std::size_t size() const noexcept { return _wide.size(); }
+
+    [[nodiscard]] std::int64_t decode(std::uint32_t payload) const {
+        return payload & WIDE ? _wide[payload & ~WIDE] : payload;
     }
+};
 
-    std::string_view to_str() const {
-        return std::visit(
-            overloaded{
-                [](Reserved token) { return reserved_string(token); },
-                [](const Identifier &token) { return std::string_view(token); },
-                [](const Integer &token) { return std::string_view(token); },
-            },
-            value);
+// Packed token. `payload` is the Symbol id for Identifier and an IntegerPool
+// encoding of the value for Integer.
+struct Token {
+    TokenKind kind{};
+    std::uint32_t offset{};
+    std::uint32_t payload{};
+
+    [[nodiscard]] bool is(TokenKind k) const noexcept { return kind == k; }
+
+    [[nodiscard]] Symbol symbol() const noexcept {
+        assert(kind == TokenKind::Identifier);
+        return Symbol(payload);
+    }
+
+    // Text of an Identifier or Integer token lexed from `source`
+    [[nodiscard]] std::string_view text(std::string_view source) const;
+
+    [[nodiscard]] std::string_view to_str(std::string_view source) const {
+        if (kind == TokenKind::Identifier || kind == TokenKind::Integer) {
+            return text(source);
+        }
+        return reserved_string(kind);
     }
 };
 
-std::vector<Token> tokenize(std::istream &);
+// Token stream stored as parallel arrays, 9 bytes per token, allocated from
+// `resource`. Integer text is viewed in the source buffer, which must outlive
+// it.
+class TokenBuffer {
+    std::string_view _source{};
+    std::pmr::vector<TokenKind> _kinds;
+    std::pmr::vector<std::uint32_t> _offsets;
+    std::pmr::vector<std::uint32_t> _payloads;
+    IntegerPool _integers;
+
+  public:
+    explicit TokenBuffer(std::string_view source = {},
+                         std::pmr::memory_resource *resource =
+                             std::pmr::get_default_resource())
+        : _source(source), _kinds(resource), _offsets(resource),
+          _payloads(resource), _integers(resource) {}
+
+    void push(Token token) {
+        _kinds.push_back(token.kind);
+        _offsets.push_back(token.offset);
+        _payloads.push_back(token.payload);
+    }
+
+    void push_integer(Token token, std::int64_t value) {
+        token.payload = _integers.encode(value);
+        push(token);
+    }
+
+    // Appends tokens lexed from the slice of this buffer's source that starts
+    // at `base`, rebasing their offsets
+    void append(const TokenBuffer &part, std::uint32_t base);
+
+    // Replaces tokens [first, last) with `part`, which was lexed from the
+    // slice of the edited `source` that starts at `base`, and moves the
+    // tokens after them by `shift` bytes
+    void splice(std::string_view source, std::size_t first, std::size_t last,
+                const TokenBuffer &part, std::uint32_t base,
+                std::int64_t shift);
+
+    [[nodiscard]] std::size_t size() const noexcept { return _kinds.size(); }
+    [[nodiscard]] bool empty() const noexcept { return _kinds.empty(); }
+    [[nodiscard]] std::string_view source() const noexcept { return _source; }
+
+    [[nodiscard]] TokenKind kind(std::size_t i) const noexcept {
+        assert(i < size());
+        return _kinds[i];
+    }
+
+    [[nodiscard]] Token operator[](std::size_t i) const noexcept {
+        assert(i < size());
+        return {_kinds[i], _offsets[i], _payloads[i]};
+    }
+
+    [[nodiscard]] Symbol symbol(std::size_t i) const noexcept {
+        return (*this)[i].symbol();
+    }
+
+    [[nodiscard]] std::int64_t value(std::size_t i) const {
+        return value((*this)[i]);
+    }
+
+    [[nodiscard]] std::int64_t value(Token token) const {
+        assert(token.is(TokenKind::Integer));
+        return _integers.decode(token.payload);
+    }
+
+    [[nodiscard]] std::string_view text(std::size_t i) const {
+        return (*this)[i].text(_source);
+    }
+
+    [[nodiscard]] std::string_view to_str(std::size_t i) const {
+        return (*this)[i].to_str(_source);
+    }
+
+    [[nodiscard]] const IntegerPool &integers() const noexcept {
+        return _integers;
+    }
+};
 
 class SyntaxError : public std::exception {
   public:
     SyntaxError(const std::string &msg) : _message(msg) {}
+    SyntaxError(const std::string &msg, std::uint32_t offset)
+        : _message(msg), _offset(offset) {}
     const char *what() const noexcept override { return _message.c_str(); }
 
+    // Source offset of the offending token, resolved with a LineTable
+    std::optional<std::uint32_t> offset() const noexcept { return _offset; }
+
   private:
     std::string _message;
+    std::optional<std::uint32_t> _offset{};
 };
+
+// Pull-based lexer: each call to next() scans just far enough to produce one
+// token, so consumers only hold the tokens they still need. Integer text is
+// viewed in the source buffer, which must outlive the lexer and its tokens.
+//
+// A lexer over a SourceStream sees the input through the stream's window and
+// refills it whenever whitespace or a token runs into the window's end, so a
+// token split across reads is lexed whole. The previous token is kept in the
+// window while there is room, for diagnostics.
+class Lexer {
+    std::string_view _source{};
+    std::size_t _pos{0};
+    IntegerPool _integers{};
+    SourceStream *_stream{nullptr};
+    std::uint64_t _base{0};     // offset of _source in the whole input
+    std::size_t _previous{0};   // start of the last token returned
+
+    [[nodiscard]] std::uint32_t offset(std::size_t pos) const {
+        return static_cast<std::uint32_t>(_base + pos);
+    }
+    bool refill();
+
+  public:
+    explicit Lexer(std::string_view source);
+    explicit Lexer(SourceStream &stream);
+
+    // Returns TokenKind::Eof once the input is exhausted, and on every call
+    // after that
+    Token next();
+
+    // Value of an Integer token returned by this lexer
+    [[nodiscard]] std::int64_t value(Token token) const {
+        assert(token.is(TokenKind::Integer));
+        return _integers.decode(token.payload);
+    }
+
+    // Spelling of a token returned by this lexer. Integers that a stream has
+    // already discarded are printed from their value.
+    void print(std::ostream &, Token) const;
+    [[nodiscard]] std::string to_str(Token token) const;
+
+    [[nodiscard]] std::string_view source() const noexcept { return _source; }
+};
+
+// Lexes the whole source up front, for dumps and batch consumers. With more
+// than one thread the source is split into chunks that are lexed
+// concurrently; the result is identical to the serial lexer's. The returned
+// buffer is allocated from `resource`; per-thread chunks use the heap.
+TokenBuffer tokenize(std::string_view, unsigned threads = 1,
+                     std::pmr::memory_resource *resource =
+                         std::pmr::get_default_resource());
@@ -0,0 +1,51 @@
+#include <algorithm>
+#include <cstring>
+
+#include "doctest.h"
+#include "location.h"
+
+void LineTable::build() const {
+    _line_starts.push_back(0);
+    const char *begin = _source.data();
+    const char *end = begin + _source.size();
+    // memchr is vectorized by the C library
+    for (const char *pos = begin; pos < end; pos++) {
+        pos = static_cast<const char *>(std::memchr(pos, '\n', end - pos));
+        if (!pos) {
+            break;
+        }
+        _line_starts.push_back(static_cast<std::uint32_t>(pos - begin + 1));
+    }
+}
+
+Location LineTable::locate(std::uint32_t offset) const {
+    if (_line_starts.empty()) {
+        build();
+    }
+    auto next_line = std::upper_bound(_line_starts.begin(),
+                                      _line_starts.end(), offset);
+    auto line = static_cast<std::uint32_t>(next_line - _line_starts.begin());
+    return {line, offset - *(next_line - 1) + 1};
+}
+
+//// TESTS ////
+
+TEST_CASE("LineTable resolves offsets to lines and columns") {
+    LineTable table("int main(void) {\n  return 2;\n\n}");
+    CHECK(table.locate(0) == Location{1, 1});
+    CHECK(table.locate(4) == Location{1, 5});
+    CHECK(table.locate(16) == Location{1, 17});
+    CHECK(table.locate(17) == Location{2, 1});
+    CHECK(table.locate(19) == Location{2, 3});
+    CHECK(table.locate(29) == Location{3, 1});
+    CHECK(table.locate(30) == Location{4, 1});
+    CHECK(table.locate(31) == Location{4, 2});
+}
+
+TEST_CASE("LineTable handles sources without newlines") {
+    LineTable empty("");
+    CHECK(empty.locate(0) == Location{1, 1});
+
+    LineTable single("return 2;");
+    CHECK(single.locate(7) == Location{1, 8});
+}
@@ -0,0 +1,27 @@
+#pragma once
+
+#include <cstdint>
+#include <string_view>
+#include <vector>
+
+struct Location {
+    std::uint32_t line{};   // 1-based
+    std::uint32_t column{}; // 1-based, in bytes
+
+    friend bool operator==(const Location &, const Location &) = default;
+};
+
+// Maps byte offsets to line/column. Tokens only carry offsets; the newline
+// index is built on the first lookup, so successful compilations never pay
+// for it.
+class LineTable {
+    std::string_view _source{};
+    mutable std::vector<std::uint32_t> _line_starts{};
+
+    void build() const;
+
+  public:
+    explicit LineTable(std::string_view source) : _source(source) {}
+
+    Location locate(std::uint32_t offset) const;
+};
@@ -1,50 +1,292 @@
-#include <fstream>
+#include <algorithm>
+#include <cstdlib>
+#include <deque>
 #include <iostream>
+#include <optional>
 #include <stdexcept>
 #include <string>
+#include <thread>
 #include <vector>
 
+#include <unistd.h>
+
 #define DOCTEST_CONFIG_IMPLEMENT
+#include "arena.h"
 #include "codegen/emission.h"
+#include "codegen/jit.h"
 #include "doctest.h"
+#include "fold.h"
+#include "interpret.h"
 #include "lexer.h"
+#include "location.h"
+#include "optimize.h"
 #include "parser.h"
+#include "source.h"
+#include "ssa.h"
+#include "stream.h"
 #include "tacky.h"
+#include "thread_pool.h"
+
+// Codegen and Link both emit assembly, which the ccx driver then assembles
+// and links for Link; Run interprets TACKY instead, and Jit runs the machine
+// code in-process
+enum class Stage { Lex, Parse, Tacky, Codegen, Link, Run, Jit };
+
+// CCX_LEX_THREADS > 1 lexes the whole file up front in parallel instead of
+// lexing on demand while parsing
+unsigned lex_threads() {
+    const char *threads = std::getenv("CCX_LEX_THREADS");
+    return threads ? std::max(1, std::atoi(threads)) : 1;
+}
+
+// CCX_THREADS caps the threads that lower functions after parsing; it
+// defaults to one per core
+unsigned compile_threads() {
+    const char *threads = std::getenv("CCX_THREADS");
+    if (threads) {
+        return std::max(1, std::atoi(threads));
+    }
+    return std::max(1u, std::thread::hardware_concurrency());
+}
 
-enum class Stage { Lex, Parse, Tacky, Codegen };
+// Owns the arenas that every stage of one compilation allocates from: the
+// first serves the front end, and each pool worker gets one of its own.
+// CCX_ARENA_SIZE sets the size of their first chunk in bytes.
+// CCX_ARENA_STATS reports their combined high-water mark after each stage
+// on stderr; arenas never free, so the last line is the peak for the whole
+// compilation.
+class Compilation {
+    std::deque<Arena> _arenas;
+    std::optional<ThreadPool> _pool;
+    bool _report;
 
-void compile(Stage stage, std::string filename) {
-    std::ifstream file(filename);
-    if (file) {
-        auto tokens = tokenize(file);
-        if (stage == Stage::Lex) {
-            for (auto token : tokens) {
-                std::cout << "Token: " << token.to_str() << std::endl;
+    static std::size_t arena_size() {
+        const char *size = std::getenv("CCX_ARENA_SIZE");
+        return size ? std::max(1ll, std::atoll(size)) : 64 * 1024;
+    }
+
+  public:
+    Compilation() : _report(std::getenv("CCX_ARENA_STATS")) {
+        _arenas.emplace_back(arena_size());
+    }
+
+    Arena &arena(unsigned worker = 0) { return _arenas[worker]; }
+
+    // Starts the pool on first use with up to `tasks` workers, so a single
+    // function never pays for threads
+    ThreadPool &pool(std::size_t tasks) {
+        if (!_pool) {
+            auto threads = static_cast<unsigned>(
+                std::min<std::size_t>(compile_threads(), tasks));
+            _pool.emplace(threads);
+            while (_arenas.size() < _pool->size()) {
+                _arenas.emplace_back(arena_size());
             }
-            return;
         }
+        return *_pool;
+    }
 
-        Ast::Parser parser(tokens);
-        auto ast = parser.parse();
-        if (stage == Stage::Parse) {
-            std::cout << ast.to_string() << std::endl;
-            return;
+    void finished(std::string_view stage) {
+        if (_report) {
+            ArenaStats stats{};
+            for (const auto &arena : _arenas) {
+                stats.used += arena.stats().used;
+                stats.reserved += arena.stats().reserved;
+            }
+            std::cerr << "arena: " << stage << ": " << stats.used
+                      << " bytes used, " << stats.reserved
+                      << " bytes reserved\n";
         }
+    }
+};
+
+// CCX_OPT_STATS reports on stderr how many TACKY instructions each
+// optimization pass removed
+void report(const Tacky::PassStats &stats) {
+    if (!std::getenv("CCX_OPT_STATS")) {
+        return;
+    }
+    for (std::size_t i = 0; i < Tacky::PASS_COUNT; i++) {
+        std::cerr << "opt: " << Tacky::PASS_NAMES[i] << ": "
+                  << stats.removed[i] << " instructions removed\n";
+    }
+    std::cerr << "opt: " << stats.rounds << " rounds, " << stats.skipped
+              << " functions skipped\n";
+}
+
+int no_main(const std::string &filename) {
+    std::cerr << (filename == "-" ? "<stdin>" : filename)
+              << ": error: no main function" << std::endl;
+    return 1;
+}
 
-        Tacky::Generator gen;
-        auto tacky_ir = gen.convert_ast(ast);
-        if (stage == Stage::Tacky) {
-            std::cout << tacky_ir.to_string() << std::endl;
-            return;
+// Interprets main of `program`
+int run_main(const std::string &filename, const Tacky::Program &program) {
+    for (const auto &fn : program.functions) {
+        if (fn.name == intern("main")) {
+            return Tacky::run(fn);
         }
+    }
+    return no_main(filename);
+}
+
+// Calls main of `program` from executable memory
+int run_main(const std::string &filename, const Asm::Program &program) {
+    Asm::JitCode code(program);
+    auto entry = code.entry(intern("main"));
+    return entry ? entry() : no_main(filename);
+}
+
+// Stages after parsing. Functions are independent from here on, so each is
+// folded, lowered, optimized and taken out of SSA form as its own pool task
+// into its worker's arena; results are indexed by function and so come out
+// in source order. Assembly is written next to the source file, or to stdout
+// when reading from stdin. Returns the exit status: what main returns under
+// Stage::Run and Stage::Jit, and 0 otherwise.
+int run_backend(Stage stage, const std::string &filename,
+                const Ast::Program &ast, Compilation &compilation) {
+    compilation.finished("parse");
+    if (stage == Stage::Parse) {
+        Ast::pretty_print(std::cout, ast);
+        std::cout << '\n';
+        return 0;
+    }
 
-        Asm::Generator asm_gen;
-        auto assembly = asm_gen.generate_assembly(tacky_ir);
+    auto count = ast.functions.size();
+    auto &pool = compilation.pool(count);
+    auto &arena = compilation.arena();
+    std::vector<Tacky::Function> tacky_fns(count);
+    std::vector<Tacky::PassStats> opt_stats(count);
+    pool.parallel_for(count, [&](std::size_t i, unsigned worker) {
+        auto &arena = compilation.arena(worker);
+        Tacky::Generator gen(arena);
+        auto fn = Ast::fold(ast.functions[i], arena);
+        auto optimized =
+            Tacky::optimize(gen.convert_function(fn), arena, opt_stats[i]);
+        tacky_fns[i] = Tacky::from_ssa(optimized, arena);
+    });
+    Tacky::Program tacky_ir{arena.copy(tacky_fns)};
+    Tacky::PassStats total{};
+    for (const auto &stats : opt_stats) {
+        total += stats;
+    }
+    report(total);
+    compilation.finished("tacky");
+    if (stage == Stage::Tacky) {
+        Tacky::pretty_print(std::cout, tacky_ir);
+        std::cout << '\n';
+        return 0;
+    }
+    if (stage == Stage::Run) {
+        return run_main(filename, tacky_ir);
+    }
+
+    std::vector<Asm::FunctionDef> asm_fns(count);
+    pool.parallel_for(count, [&](std::size_t i, unsigned worker) {
+        Asm::Generator gen(compilation.arena(worker));
+        asm_fns[i] = gen.generate_function(tacky_ir.functions[i]);
+    });
+    Asm::Program assembly{arena.copy(asm_fns)};
+    compilation.finished("codegen");
+    if (stage == Stage::Jit) {
+        return run_main(filename, assembly);
+    }
+    if (filename == "-") {
+        Asm::emit_code(assembly, std::cout);
+    } else {
         Asm::emit_code(assembly, filename);
     }
+    return 0;
+}
+
+int run_stages(Stage stage, std::string filename, std::string_view source) {
+    auto threads = lex_threads();
+    Compilation compilation{};
+    auto &arena = compilation.arena();
+    if (stage == Stage::Lex) {
+        auto tokens = tokenize(source, threads, &arena);
+        compilation.finished("lex");
+        for (std::size_t i = 0; i < tokens.size(); i++) {
+            std::cout << "Token: " << tokens.to_str(i) << '\n';
+        }
+        return 0;
+    }
+
+    auto tokens = threads > 1 ? tokenize(source, threads, &arena)
+                              : TokenBuffer(source, &arena);
+    if (threads > 1) {
+        compilation.finished("lex");
+    }
+    auto parser = threads > 1 ? Ast::Parser(tokens, arena)
+                              : Ast::Parser(source, arena);
+    auto ast = parser.parse();
+    return run_backend(stage, filename, ast, compilation);
+}
+
+// Input from a pipe is lexed through a fixed-size window, so memory does not
+// grow with its length. Lexing is part of the parse stage here.
+int run_stream_stages(Stage stage, SourceStream &stream) {
+    if (stage == Stage::Lex) {
+        Lexer lexer(stream);
+        for (auto token = lexer.next(); !token.is(TokenKind::Eof);
+             token = lexer.next()) {
+            std::cout << "Token: ";
+            lexer.print(std::cout, token);
+            std::cout << '\n';
+        }
+        return 0;
+    }
+
+    Compilation compilation{};
+    Ast::Parser parser(stream, compilation.arena());
+    auto ast = parser.parse();
+    return run_backend(stage, "-", ast, compilation);
+}
+
+// Runs `stages`, reporting a syntax error against `filename` at the location
+// `locate` gives its offset. Returns the exit status of `stages`, or 1 after
+// reporting an error.
+template <typename Stages, typename Locate>
+int report_syntax_errors(const std::string &filename, Stages stages,
+                         Locate locate) {
+    try {
+        return stages();
+    } catch (const SyntaxError &error) {
+        std::cerr << filename;
+        if (auto offset = error.offset()) {
+            auto location = locate(*offset);
+            std::cerr << ':' << location.line << ':' << location.column;
+        }
+        std::cerr << ": error: " << error.what() << std::endl;
+        return 1;
+    }
+}
+
+// Compiles `filename`, or stdin when it is "-". Returns the exit status, as
+// for run_backend.
+int compile(Stage stage, std::string filename) {
+    if (filename == "-") {
+        SourceStream stream(STDIN_FILENO);
+        return report_syntax_errors(
+            "<stdin>", [&] { return run_stream_stages(stage, stream); },
+            [&](std::uint32_t offset) { return stream.locate(offset); });
+    }
+
+    SourceFile file(filename);
+    if (!file) {
+        return 0;
+    }
+    return report_syntax_errors(
+        filename, [&] { return run_stages(stage, filename, file.text()); },
+        [&](std::uint32_t offset) {
+            return LineTable(file.text()).locate(offset);
+        });
 }
 
 int main(int argc, char *argv[]) {
+    // Dumps are written through std::cout's own buffer rather than stdio's
+    std::ios::sync_with_stdio(false);
+
     doctest::Context ctx;
     ctx.applyCommandLine(argc, argv);
     int test_results = ctx.run();
@@ -52,6 +294,8 @@ int main(int argc, char *argv[]) {
         return test_results;
     }
 
-    compile(Stage(std::stoi(argv[2])), argv[1]);
+    if (auto status = compile(Stage(std::stoi(argv[2])), argv[1])) {
+        return status;
+    }
     return test_results;
 }
@@ -0,0 +1,342 @@
+#include <algorithm>
+#include <cstdint>
+#include <optional>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "doctest.h"
+#include "fold.h"
+#include "interpret.h"
+#include "optimize.h"
+#include "ssa.h"
+
+namespace Tacky {
+namespace {
+// A function being optimized, in buffers the passes can edit
+struct Body {
+    std::pmr::vector<Instruction> instrs;
+    std::pmr::vector<std::int64_t> constants;
+    std::uint32_t registers;
+
+    Body(const Function &fn, Arena &arena)
+        : instrs(fn.body.begin(), fn.body.end(), &arena),
+          constants(fn.constants.begin(), fn.constants.end(), &arena),
+          registers(fn.registers) {}
+
+    std::int64_t value(Val val) const { return constants[index(val)]; }
+    Val add_constant(std::int64_t value) {
+        constants.push_back(value);
+        return pooled(static_cast<std::uint32_t>(constants.size() - 1));
+    }
+
+    // Keeps the instructions `keep` accepts, in order. Returns how many
+    // were dropped.
+    template <typename Keep> std::size_t filter(Keep keep) {
+        std::size_t kept = 0;
+        for (std::size_t i = 0; i < instrs.size(); i++) {
+            if (keep(instrs[i], i)) {
+                instrs[kept++] = instrs[i];
+            }
+        }
+        auto removed = instrs.size() - kept;
+        instrs.resize(kept);
+        return removed;
+    }
+};
+
+// Operands that stand in for registers whose instructions were removed.
+// With each register assigned once, a replacement holds for every later use.
+class Substitution {
+    std::vector<Val> _to;
+
+  public:
+    explicit Substitution(std::uint32_t registers) : _to(registers) {
+        for (std::uint32_t i = 0; i < registers; i++) {
+            _to[i] = reg(i);
+        }
+    }
+
+    Val operator()(Val val) const {
+        return is_constant(val) ? val : _to[index(val)];
+    }
+    void replace(Val reg, Val with) { _to[index(reg)] = with; }
+};
+
+// Straight-line code ends at its first Return
+std::size_t remove_unreachable_code(Body &body) {
+    auto ret = std::find_if(
+        body.instrs.begin(), body.instrs.end(),
+        [](const Instruction &instr) {
+            return instr.is(Instruction::Kind::Return);
+        });
+    if (ret == body.instrs.end()) {
+        return 0;
+    }
+    auto removed = static_cast<std::size_t>(body.instrs.end() - ret - 1);
+    body.instrs.erase(ret + 1, body.instrs.end());
+    return removed;
+}
+
+// Evaluates unary operators on constants, and has later instructions read
+// the result from the constant pool
+std::size_t fold_constants(Body &body) {
+    Substitution substitute(body.registers);
+    return body.filter([&](Instruction &instr, std::size_t) {
+        if (instr.is(Instruction::Kind::Return)) {
+            instr.return_().val = substitute(instr.return_().val);
+            return true;
+        }
+        auto &unary = instr.unary();
+        unary.src = substitute(unary.src);
+        if (!is_constant(unary.src)) {
+            return true;
+        }
+        auto value = apply(unary.op, body.value(unary.src));
+        substitute.replace(unary.dst, body.add_constant(value));
+        return false;
+    });
+}
+
+// TACKY has no Copy instruction; the copies it does hold are -(-x) and
+// ~~x, whose result is x. Those instructions are removed and their uses
+// read x instead.
+std::size_t propagate_copies(Body &body) {
+    Substitution substitute(body.registers);
+    // Operator and operand of the kept instruction assigning each register
+    std::vector<std::optional<std::pair<UnaryOperator, Val>>> defs(
+        body.registers);
+    return body.filter([&](Instruction &instr, std::size_t) {
+        if (instr.is(Instruction::Kind::Return)) {
+            instr.return_().val = substitute(instr.return_().val);
+            return true;
+        }
+        auto &unary = instr.unary();
+        unary.src = substitute(unary.src);
+        if (!is_constant(unary.src)) {
+            const auto &def = defs[index(unary.src)];
+            if (def && def->first == unary.op) {
+                substitute.replace(unary.dst, def->second);
+                return false;
+            }
+        }
+        defs[index(unary.dst)] = {unary.op, unary.src};
+        return true;
+    });
+}
+
+// Removes instructions whose result is never read, walking backwards so a
+// chain of them goes in one pass
+std::size_t remove_dead_stores(Body &body) {
+    std::vector<bool> live(body.registers);
+    std::vector<bool> dead(body.instrs.size());
+    auto use = [&](Val val) {
+        if (!is_constant(val)) {
+            live[index(val)] = true;
+        }
+    };
+    for (auto i = body.instrs.size(); i-- > 0;) {
+        const auto &instr = body.instrs[i];
+        if (instr.is(Instruction::Kind::Return)) {
+            use(instr.return_().val);
+        } else if (!live[index(instr.unary().dst)]) {
+            dead[i] = true;
+        } else {
+            use(instr.unary().src);
+        }
+    }
+    return body.filter(
+        [&](const Instruction &, std::size_t i) { return !dead[i]; });
+}
+
+// Drops constants nothing reads any more and merges equal ones
+void compact_constants(Body &body, Arena &arena) {
+    std::pmr::vector<std::int64_t> kept(&arena);
+    std::unordered_map<std::int64_t, std::uint32_t> slots{};
+    auto visit = [&](Val &val) {
+        if (!is_constant(val)) {
+            return;
+        }
+        auto [slot, added] = slots.try_emplace(
+            body.value(val), static_cast<std::uint32_t>(kept.size()));
+        if (added) {
+            kept.push_back(body.value(val));
+        }
+        val = pooled(slot->second);
+    };
+    for (auto &instr : body.instrs) {
+        if (instr.is(Instruction::Kind::Return)) {
+            visit(instr.return_().val);
+        } else {
+            visit(instr.unary().src);
+        }
+    }
+    body.constants.swap(kept);
+}
+} // namespace
+
+Function optimize(const Function &fn, Arena &arena, PassStats &stats,
+                  std::size_t max_rounds) {
+    if (!well_formed(fn)) {
+        stats.skipped++;
+        return fn;
+    }
+
+    Body body(is_ssa(fn) ? fn : to_ssa(fn, arena), arena);
+    for (std::size_t round = 0; round < max_rounds; round++) {
+        stats.rounds++;
+        std::size_t removed = 0;
+        auto run = [&](Pass pass, std::size_t count) {
+            stats[pass] += count;
+            removed += count;
+        };
+        run(Pass::UnreachableCode, remove_unreachable_code(body));
+        run(Pass::ConstantFolding, fold_constants(body));
+        run(Pass::CopyPropagation, propagate_copies(body));
+        run(Pass::DeadStores, remove_dead_stores(body));
+        if (removed == 0) {
+            break;
+        }
+    }
+    compact_constants(body, arena);
+    return Function{fn.name, arena.adopt(body.instrs),
+                    arena.adopt(body.constants), body.registers};
+}
+} // namespace Tacky
+
+//// TESTS ////
+
+namespace {
+using Tacky::Instruction;
+using Tacky::UnaryOperator;
+
+// Builds TACKY by hand, since Generator only sees folded ASTs in practice
+struct Builder {
+    std::vector<Instruction> body{};
+    std::vector<std::int64_t> constants{};
+    std::uint32_t registers{};
+
+    Tacky::Val constant(std::int64_t value) {
+        constants.push_back(value);
+        return Tacky::pooled(static_cast<std::uint32_t>(constants.size() - 1));
+    }
+    Tacky::Val unary(UnaryOperator op, Tacky::Val src) {
+        auto dst = Tacky::reg(registers++);
+        body.emplace_back(Instruction::Unary{op, src, dst});
+        return dst;
+    }
+    void ret(Tacky::Val val) { body.emplace_back(Instruction::Return{val}); }
+
+    Tacky::Function function() const {
+        return {intern("f"), body, constants, registers};
+    }
+};
+
+std::string listing(const Tacky::Function &fn) {
+    std::string out{};
+    for (const auto &instr : fn.body) {
+        out += (out.empty() ? "" : "; ") + to_string(fn, instr);
+    }
+    return out;
+}
+} // namespace
+
+TEST_CASE("optimize folds constant chains") {
+    Builder b{};
+    auto x = b.unary(UnaryOperator::Negate, b.constant(5));
+    x = b.unary(UnaryOperator::Complement, x);
+    b.ret(b.unary(UnaryOperator::Negate, x));
+
+    Arena arena{};
+    Tacky::PassStats stats{};
+    auto fn = Tacky::optimize(b.function(), arena, stats);
+    CHECK(listing(fn) == "Return(Constant(-4))");
+    CHECK(fn.constants.size() == 1);
+    CHECK(stats[Tacky::Pass::ConstantFolding] == 3);
+    CHECK(stats.rounds == 2);
+}
+
+TEST_CASE("optimize wraps like the emitted 32-bit instructions") {
+    Builder b{};
+    b.ret(b.unary(UnaryOperator::Negate, b.constant(-2147483648)));
+    Arena arena{};
+    Tacky::PassStats stats{};
+    auto fn = Tacky::optimize(b.function(), arena, stats);
+    CHECK(listing(fn) == "Return(Constant(-2147483648))");
+}
+
+TEST_CASE("optimize propagates double negations and drops dead stores") {
+    // A register operand keeps the chain from folding
+    Builder b{};
+    auto input = Tacky::reg(b.registers++);
+    auto once = b.unary(UnaryOperator::Negate, input);
+    auto twice = b.unary(UnaryOperator::Negate, once);
+    auto kept = b.unary(UnaryOperator::Complement, twice);
+    b.unary(UnaryOperator::Complement, kept); // never read
+    b.ret(kept);
+    b.ret(once);
+
+    Arena arena{};
+    Tacky::PassStats stats{};
+    auto fn = Tacky::optimize(b.function(), arena, stats);
+    CHECK(listing(fn) == "Unary(Complement, Var(f.0), Var(f.3)); "
+                         "Return(Var(f.3))");
+    CHECK(stats[Tacky::Pass::UnreachableCode] == 1);
+    // ~Var(f.3) is ~~Var(f.0), so copy propagation removes it as well
+    CHECK(stats[Tacky::Pass::CopyPropagation] == 2);
+    CHECK(stats[Tacky::Pass::DeadStores] == 1);
+    CHECK(stats[Tacky::Pass::ConstantFolding] == 0);
+}
+
+TEST_CASE("optimize stops at its round limit") {
+    Builder b{};
+    auto x = b.constant(1);
+    for (int i = 0; i < 10; i++) {
+        x = b.unary(UnaryOperator::Negate, x);
+    }
+    b.ret(x);
+
+    Arena arena{};
+    Tacky::PassStats stats{};
+    auto fn = Tacky::optimize(b.function(), arena, stats, 1);
+    CHECK(stats.rounds == 1);
+    CHECK(listing(fn) == "Return(Constant(1))");
+}
+
+TEST_CASE("optimize renames functions that assign a register twice") {
+    Builder b{};
+    auto x = b.unary(UnaryOperator::Negate, b.constant(1));
+    b.body.emplace_back(Instruction::Unary{UnaryOperator::Negate, x, x});
+    b.ret(x);
+
+    Arena arena{};
+    Tacky::PassStats stats{};
+    auto fn = Tacky::optimize(b.function(), arena, stats);
+    CHECK(stats.skipped == 0);
+    CHECK(listing(fn) == "Return(Constant(1))");
+}
+
+TEST_CASE("optimize leaves functions with operands out of range") {
+    Builder b{};
+    b.ret(Tacky::reg(3));
+    Arena arena{};
+    Tacky::PassStats stats{};
+    auto fn = Tacky::optimize(b.function(), arena, stats);
+    CHECK(stats.skipped == 1);
+    CHECK(fn.body.size() == 1);
+}
+
+TEST_CASE("optimize agrees with folding the AST") {
+    Arena arena{};
+    Ast::Parser parser("int main(void) { return ~(-(~(-(~2147483647)))); }",
+                       arena);
+    auto ast = parser.parse().functions[0];
+    Tacky::Generator gen(arena);
+    auto lowered = gen.convert_function(ast);
+    auto folded = gen.convert_function(Ast::fold(ast, arena));
+    Tacky::PassStats stats{};
+    auto fn = Tacky::optimize(lowered, arena, stats);
+    CHECK(listing(fn) == listing(folded));
+    CHECK(listing(fn) == "Return(Constant(2147483646))");
+    CHECK(stats[Tacky::Pass::ConstantFolding] == 5);
+}
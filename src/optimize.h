@@ -0,0 +1,49 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <string_view>
+
+#include "arena.h"
+#include "tacky.h"
+
+namespace Tacky {
+enum class Pass : std::uint8_t {
+    UnreachableCode,
+    ConstantFolding,
+    CopyPropagation,
+    DeadStores,
+};
+
+constexpr std::size_t PASS_COUNT = 4;
+constexpr std::array<std::string_view, PASS_COUNT> PASS_NAMES{
+    "unreachable-code", "constant-folding", "copy-propagation",
+    "dead-stores"};
+
+// What the optimizer did, summed over the functions it was given
+struct PassStats {
+    std::array<std::size_t, PASS_COUNT> removed{}; // instructions, per Pass
+    std::size_t rounds{};                          // summed over functions
+    std::size_t skipped{}; // functions with operands out of range
+
+    std::size_t &operator[](Pass pass) {
+        return removed[static_cast<std::size_t>(pass)];
+    }
+    PassStats &operator+=(const PassStats &other) {
+        for (std::size_t i = 0; i < PASS_COUNT; i++) {
+            removed[i] += other.removed[i];
+        }
+        rounds += other.rounds;
+        skipped += other.skipped;
+        return *this;
+    }
+};
+
+// Runs every pass over `fn` until a round removes nothing or `max_rounds`
+// rounds have run. The passes rely on each register being assigned once, so
+// a function that is not in SSA form is renamed into it first; one that is
+// not well formed is returned unchanged. The result is in SSA form and
+// allocated in `arena`.
+Function optimize(const Function &fn, Arena &arena, PassStats &stats,
+                  std::size_t max_rounds = 8);
+} // namespace Tacky
@@ -1,259 +1,612 @@
+#include <algorithm>
 #include <iostream>
-#include <memory>
+#include <sstream>
+#include <vector>
+
+#include <unistd.h>
 
 #include "doctest.h"
 #include "lexer.h"
 #include "parser.h"
 
 namespace Ast {
+namespace {
+// Diagnostic names for the symbols that are not fixed spellings
+std::string_view describe(TokenKind token_class) {
+    return token_class == TokenKind::Identifier ? "function name"
+                                                : "integer literal";
+}
+
+std::string_view describe(Grammar::Nonterminal nonterminal) {
+    switch (nonterminal) {
+    case Grammar::Nonterminal::Program:
+        return "program";
+    case Grammar::Nonterminal::FunctionList:
+    case Grammar::Nonterminal::Function:
+        return "function";
+    case Grammar::Nonterminal::Statement:
+        return "statement";
+    case Grammar::Nonterminal::Exp:
+        return "expression";
+    case Grammar::Nonterminal::Unop:
+        return "unary operator";
+    }
+    return "syntax";
+}
+} // namespace
+
+void pretty_print(std::ostream &out, const Function &fn, int indent) {
+    auto pad = [&](int width) {
+        for (int i = 0; i < width; i++) {
+            out.put(' ');
+        }
+    };
+    out << "Function(\n";
+    pad(indent + 2);
+    out << "name=\"" << fn.name.to_str() << "\",\n";
+    pad(indent + 2);
+    out << "body=";
+    print(out, fn.body);
+    out.put('\n');
+    pad(indent);
+    out.put(')');
+}
+
+void pretty_print(std::ostream &out, const Program &program) {
+    out << "Program(";
+    for (std::size_t i = 0; i < program.functions.size(); i++) {
+        out << (i ? ",\n  " : "\n  ");
+        pretty_print(out, program.functions[i], 2);
+    }
+    out << "\n)";
+}
+
+SyntaxError redefinition(Symbol name, std::uint32_t offset) {
+    return SyntaxError(
+        std::format("Redefinition of function {}", name.to_str()), offset);
+}
+
 Program Parser::parse() {
-    auto fn = parse_function();
-    if (_current_token != _tokens.size()) {
-        throw SyntaxError(std::format("Unexpected token found: {}",
-                                      _tokens[_current_token].to_str()));
+    auto program =
+        std::get<Program>(parse_rule(Grammar::Nonterminal::Program));
+    if (!_next.is(TokenKind::Eof)) {
+        throw SyntaxError(
+            std::format("Unexpected token found: {}", to_str(_next)),
+            _next.offset);
     }
+    return program;
+}
+
+Function Parser::parse_function() {
+    return std::get<Function>(parse_rule(Grammar::Nonterminal::Function));
+}
+
+void Parser::expect_next_function() {
+    if (!at_end() && !_next.is(TokenKind::IntType)) {
+        unexpected(Grammar::Nonterminal::FunctionList);
+    }
+}
 
-    Program ast(std::move(fn));
-    return ast;
+Return Parser::parse_statement() {
+    return std::get<Return>(parse_rule(Grammar::Nonterminal::Statement));
 }
 
-void Parser::expect(std::string expected) {
-    if (_current_token == _tokens.size()) {
-        throw SyntaxError(std::format("Missing \"{}\"", expected));
+const Exp *Parser::parse_exp() {
+    return std::get<const Exp *>(parse_rule(Grammar::Nonterminal::Exp));
+}
+
+Token Parser::expect(TokenKind expected) {
+    if (_next.is(TokenKind::Eof)) {
+        throw SyntaxError(
+            std::format("Missing \"{}\"", reserved_string(expected)),
+            _next.offset);
     }
 
-    const Token &actual = _tokens[_current_token++];
-    if (actual.to_str() != expected) {
+    auto actual = take();
+    if (!actual.is(expected)) {
         throw SyntaxError(std::format("Expected \"{}\" but got \"{}\"",
-                                      expected, actual.to_str()));
+                                      reserved_string(expected),
+                                      to_str(actual)),
+                          actual.offset);
     }
+    return actual;
 }
 
-std::unique_ptr<Function> Parser::parse_function() {
-    expect("int");
-    const Token &name = _tokens[_current_token++];
-    if (!name.is<Identifier>()) {
-        throw SyntaxError(
-            std::format("Invalid function name: {}", name.to_str()));
+// Like expect(), but token classes are reported by what they stand for
+Token Parser::match(TokenKind expected) {
+    if (expected != TokenKind::Identifier && expected != TokenKind::Integer) {
+        return expect(expected);
+    }
+    if (_next.is(TokenKind::Eof)) {
+        throw SyntaxError(std::format("Missing {}", describe(expected)),
+                          _next.offset);
     }
-    expect("(");
-    expect("void");
-    expect(")");
-    expect("{");
-    auto statement = parse_statement();
-    expect("}");
-    return std::make_unique<Function>(name.to_str(), std::move(statement));
+
+    auto actual = take();
+    if (!actual.is(expected)) {
+        throw SyntaxError(std::format("Invalid {}: {}", describe(expected),
+                                      to_str(actual)),
+                          actual.offset);
+    }
+    return actual;
 }
 
-std::unique_ptr<Statement> Parser::parse_statement() {
-    expect("return");
-    auto exp = parse_exp();
-    expect(";");
-    return std::make_unique<Return>(std::move(exp));
+// No production of `nonterminal` starts with the next token. Where the
+// nonterminal could have been empty, the token is simply out of place. A
+// nonterminal that can only start one way is reported as that token being
+// expected.
+void Parser::unexpected(Grammar::Nonterminal nonterminal) {
+    auto index = static_cast<std::size_t>(nonterminal);
+    if (Grammar::NULLABLE[index]) {
+        throw SyntaxError(
+            std::format("Unexpected token found: {}", to_str(_next)),
+            _next.offset);
+    }
+    auto first = Grammar::FIRST_BEGIN[index];
+    if (Grammar::FIRST_BEGIN[index + 1] - first == 1) {
+        match(Grammar::FIRST[first]);
+    }
+    if (_next.is(TokenKind::Eof)) {
+        throw SyntaxError(std::format("Invalid {}", describe(nonterminal)),
+                          _next.offset);
+    }
+    throw SyntaxError(std::format("Invalid {}: {}", describe(nonterminal),
+                                  to_str(_next)),
+                      _next.offset);
 }
 
-std::unique_ptr<Exp> Parser::parse_exp() {
-    if (_current_token >= _tokens.size()) {
-        throw SyntaxError(std::format("Invalid expression"));
+const Exp *Parser::make_exp(const Exp &exp) {
+    ExpKey key{exp.kind()};
+    if (exp.is(Exp::Kind::Constant)) {
+        key.value = exp.constant().value;
+    } else {
+        key.op = exp.unary().op;
+        key.value = reinterpret_cast<std::intptr_t>(exp.unary().exp);
+    }
+    auto [it, inserted] = _exps.try_emplace(key);
+    if (inserted) {
+        it->second = _arena.make<Exp>(exp);
     }
+    return it->second;
+}
 
-    const Token &token = _tokens[_current_token++];
-    if (token.is<Integer>()) {
-        return std::make_unique<Constant>(token.to_str());
-    } else if (token.is<Identifier>()) {
-        throw SyntaxError(
-            std::format("Invalid expression: {}", token.to_str()));
+// Symbols still to be matched sit on an explicit stack, each expansion
+// preceded by a marker that builds its node once the symbols are matched,
+// so nesting depth is bounded by memory rather than by the call stack
+SemanticValue Parser::parse_rule(Grammar::Nonterminal start) {
+    struct Step {
+        enum : std::uint8_t { Terminal, Nonterminal, Reduce } kind;
+        std::uint8_t id;
+    };
+
+    std::vector<Step> steps{{Step::Nonterminal,
+                             static_cast<std::uint8_t>(start)}};
+    std::vector<SemanticValue> values{};
+    while (!steps.empty()) {
+        auto step = steps.back();
+        steps.pop_back();
+        switch (step.kind) {
+        case Step::Terminal:
+            values.emplace_back(match(static_cast<TokenKind>(step.id)));
+            break;
+        case Step::Nonterminal: {
+            auto production =
+                Grammar::PARSE_TABLE[step.id][static_cast<std::size_t>(
+                    _next.kind)];
+            if (production == Grammar::NO_PRODUCTION) {
+                unexpected(static_cast<Grammar::Nonterminal>(step.id));
+            }
+            steps.push_back({Step::Reduce, production});
+            for (auto i = Grammar::RHS_BEGIN[production + 1];
+                 i-- > Grammar::RHS_BEGIN[production];) {
+                auto symbol = Grammar::RHS[i];
+                steps.push_back(
+                    {symbol.terminal ? Step::Terminal : Step::Nonterminal,
+                     symbol.id});
+            }
+            break;
+        }
+        case Step::Reduce:
+            reduce(static_cast<Grammar::Production>(step.id), values);
+            break;
+        }
     }
+    return std::move(values.back());
+}
 
-    if (token.is(Reserved::Complement)) {
-        return std::make_unique<Unary>(std::make_unique<Complement>(),
-                                       parse_exp());
-    } else if (token.is(Reserved::Negate)) {
-        return std::make_unique<Unary>(std::make_unique<Negate>(), parse_exp());
-    } else if (token.is(Reserved::OpenParen)) {
-        auto exp = parse_exp();
-        expect(")");
-        return exp;
+// Replaces the values of a production's right-hand side with its node. The
+// indices below follow the symbol positions in grammar.ebnf.
+void Parser::reduce(Grammar::Production production,
+                    std::vector<SemanticValue> &values) {
+    using Grammar::Production;
+    auto index = static_cast<std::size_t>(production);
+    auto rhs = values.end() -
+               (Grammar::RHS_BEGIN[index + 1] - Grammar::RHS_BEGIN[index]);
+    auto exp = [&](std::size_t i) { return std::get<const Exp *>(rhs[i]); };
+
+    SemanticValue node{};
+    switch (production) {
+    case Production::Program: // <function> <function-list>
+    case Production::FunctionList0: { // <function> <function-list>
+        // The innermost list is reduced first, so functions are collected
+        // last to first
+        auto functions = std::get<FunctionList>(std::move(rhs[1]));
+        functions.push_back(std::get<Function>(rhs[0]));
+        if (production == Production::Program) {
+            std::reverse(functions.begin(), functions.end());
+            node = Program{_arena.adopt(functions)};
+        } else {
+            node = std::move(functions);
+        }
+        break;
     }
-    throw SyntaxError(std::format("Invalid expression: {}", token.to_str()));
+    case Production::FunctionList1: // ""
+        node = FunctionList(&_arena);
+        break;
+    case Production::Function: { // "int" <identifier> ... <statement> "}"
+        auto name = std::get<Token>(rhs[1]);
+        if (!_defined.insert(name.symbol()).second) {
+            throw redefinition(name.symbol(), name.offset);
+        }
+        node = Function{name.symbol(), std::get<Return>(rhs[6])};
+        break;
+    }
+    case Production::Statement: // "return" <exp> ";"
+        node = Return{exp(1)};
+        break;
+    case Production::Exp0: // <int>
+        node = make_exp(Exp::Constant{value(std::get<Token>(rhs[0]))});
+        break;
+    case Production::Exp1: // <unop> <exp>
+        node = make_exp(Exp::Unary{std::get<UnaryOperator>(rhs[0]), exp(1)});
+        break;
+    case Production::Exp2: // "(" <exp> ")"
+        node = rhs[1];
+        break;
+    case Production::Unop0: // "-"
+        node = UnaryOperator::Negate;
+        break;
+    case Production::Unop1: // "~"
+        node = UnaryOperator::Complement;
+        break;
+    }
+    values.erase(rhs, values.end());
+    values.push_back(std::move(node));
 }
 
 //// TESTS ////
 
+namespace {
+template <typename Node> std::string pretty(const Node &node) {
+    std::ostringstream out{};
+    pretty_print(out, node);
+    return out.str();
+}
+} // namespace
+
+TEST_CASE("Parser::parse_exp handles deep nesting without recursion") {
+    constexpr std::size_t depth = 250'000;
+    std::string source{};
+    for (std::size_t i = 0; i < depth; i++) {
+        source += i % 2 ? "-(" : "~(";
+    }
+    source += "7";
+    source.append(depth, ')');
+
+    Arena arena{};
+    Parser parser(source, arena);
+    auto printed = dump(*parser.parse_exp());
+    CHECK(printed.size() ==
+          depth * std::string("Unary(Complement, )").size() / 2 +
+              depth * std::string("Unary(Negate, )").size() / 2 +
+              std::string("Constant(7)").size());
+    CHECK(printed.starts_with("Unary(Complement, Unary(Negate, Unary("));
+    auto innermost = std::string_view("Unary(Negate, Constant(7)");
+    CHECK(printed.rfind(innermost) ==
+          printed.size() - innermost.size() - depth);
+
+    source.pop_back();
+    Parser unbalanced(source, arena);
+    REQUIRE_THROWS_WITH_AS(unbalanced.parse_exp(), "Missing \")\"",
+                           SyntaxError);
+}
+
+TEST_CASE("grammar tables are generated from grammar.ebnf") {
+    using Grammar::Nonterminal;
+    auto set = [](const auto &begin, const auto &terminals, Nonterminal n) {
+        auto i = static_cast<std::size_t>(n);
+        return std::vector<TokenKind>(terminals.begin() + begin[i],
+                                      terminals.begin() + begin[i + 1]);
+    };
+    using Kinds = std::vector<TokenKind>;
+    CHECK(set(Grammar::FIRST_BEGIN, Grammar::FIRST, Nonterminal::Exp) ==
+          Kinds{TokenKind::Integer, TokenKind::OpenParen, TokenKind::Negate,
+                TokenKind::Complement});
+    CHECK(set(Grammar::FOLLOW_BEGIN, Grammar::FOLLOW, Nonterminal::Exp) ==
+          Kinds{TokenKind::Semicolon, TokenKind::CloseParen});
+    CHECK(set(Grammar::FOLLOW_BEGIN, Grammar::FOLLOW, Nonterminal::Program) ==
+          Kinds{TokenKind::Eof});
+
+    auto exp = Grammar::PARSE_TABLE[static_cast<std::size_t>(Nonterminal::Exp)];
+    CHECK(exp[static_cast<std::size_t>(TokenKind::OpenParen)] ==
+          static_cast<std::uint8_t>(Grammar::Production::Exp2));
+    CHECK(exp[static_cast<std::size_t>(TokenKind::Semicolon)] ==
+          Grammar::NO_PRODUCTION);
+}
+
+TEST_CASE("Parser::parse_function without a name") {
+    Arena arena{};
+    Parser parser("int", arena);
+    REQUIRE_THROWS_WITH_AS(parser.parse_function(), "Missing function name",
+                           SyntaxError);
+}
+
 TEST_CASE("Parser::parse_exp for decrement") {
-    Parser parser(
-        std::vector<Token>({{Reserved::Decrement}, {Integer{"100"}}}));
+    Arena arena{};
+    Parser parser("--100", arena);
     REQUIRE_THROWS_WITH_AS(parser.parse_exp(), "Invalid expression: --",
                            SyntaxError);
 }
 
 TEST_CASE("Parser::parse_exp for parenthesized expression") {
-    Parser parser(std::vector<Token>({{Reserved::Complement},
-                                      {Reserved::OpenParen},
-                                      {Reserved::Negate},
-                                      {Integer{"100"}},
-                                      {Reserved::CloseParen}}));
-    auto exp = parser.parse_exp();
-    CHECK(exp->to_string() == "Complement(Negate(Constant(100)))");
-
-    parser = Parser(std::vector<Token>({{Reserved::Complement},
-                                        {Reserved::OpenParen},
-                                        {Reserved::OpenParen},
-                                        {Reserved::OpenParen},
-                                        {Reserved::Negate},
-                                        {Integer{"100"}},
-                                        {Reserved::CloseParen},
-                                        {Reserved::CloseParen},
-                                        {Reserved::CloseParen}}));
-    CHECK(parser.parse_exp()->to_string() ==
-          "Complement(Negate(Constant(100)))");
-
-    parser = Parser(std::vector<Token>({
-        {Reserved::Complement},
-        {Reserved::OpenParen},
-        {Reserved::Negate},
-        {Integer{"100"}},
-    }));
-    REQUIRE_THROWS_WITH_AS(parser.parse_exp(), "Missing \")\"", SyntaxError);
+    Arena arena{};
+    Parser parser("~(-100)", arena);
+    CHECK(dump(*parser.parse_exp()) ==
+          "Unary(Complement, Unary(Negate, Constant(100)))");
+
+    Parser nested("~(((-100)))", arena);
+    CHECK(dump(*nested.parse_exp()) ==
+          "Unary(Complement, Unary(Negate, Constant(100)))");
+
+    Parser unbalanced("~(-100", arena);
+    REQUIRE_THROWS_WITH_AS(unbalanced.parse_exp(), "Missing \")\"",
+                           SyntaxError);
 }
 
 TEST_CASE("Parser::parse_exp for negation as a suffix") {
-    Parser parser(std::vector<Token>{{Reserved::Negate}});
+    Arena arena{};
+    Parser parser("-", arena);
     REQUIRE_THROWS_WITH_AS(parser.parse_exp(), "Invalid expression",
                            SyntaxError);
 }
 
 TEST_CASE("Parser::parse_exp for negation") {
-    Parser parser(std::vector<Token>({{Reserved::Negate}, {Integer{"100"}}}));
+    Arena arena{};
+    Parser parser("-100", arena);
     auto exp = parser.parse_exp();
-    CHECK(exp->to_string() == "Negate(Constant(100))");
+    REQUIRE(exp->is(Exp::Kind::Unary));
+    CHECK(exp->unary().op == UnaryOperator::Negate);
+    CHECK(dump(*exp) == "Unary(Negate, Constant(100))");
 }
 
 TEST_CASE("Parser::parse_exp for bitwise complement") {
-    Parser parser(
-        std::vector<Token>({{Reserved::Complement}, {Integer{"100"}}}));
-    auto exp = parser.parse_exp();
-    CHECK(exp->to_string() == "Complement(Constant(100))");
+    Arena arena{};
+    Parser parser("~100", arena);
+    CHECK(dump(*parser.parse_exp()) == "Unary(Complement, Constant(100))");
 }
 
 TEST_CASE("Parser::parse with extra tokens") {
-    std::vector<Token> tokens{
-        {Reserved::IntType},    {Identifier{"my_function"}},
-        {Reserved::OpenParen},  {Reserved::Void},
-        {Reserved::CloseParen}, {Reserved::OpenBrace},
-        {Reserved::Return},     {Integer{"420"}},
-        {Reserved::Semicolon},  {Reserved::CloseBrace},
-        {Identifier{"foo"}},    {Identifier{"bar"}}};
-    Parser parser(tokens);
+    Arena arena{};
+    Parser parser("int my_function(void) { return 420; } foo bar", arena);
     REQUIRE_THROWS_WITH_AS(parser.parse(), "Unexpected token found: foo",
                            SyntaxError);
 }
 
 TEST_CASE("Parser::parse success") {
-    std::vector<Token> tokens{
-        {Reserved::IntType},    {Identifier{"my_function"}},
-        {Reserved::OpenParen},  {Reserved::Void},
-        {Reserved::CloseParen}, {Reserved::OpenBrace},
-        {Reserved::Return},     {Integer{"420"}},
-        {Reserved::Semicolon},  {Reserved::CloseBrace}};
-    Parser parser(tokens);
+    Arena arena{};
+    Parser parser("int my_function(void) { return 420; }", arena);
     auto ast = parser.parse();
-    CHECK(ast.to_string() ==
+    CHECK(pretty(ast) ==
           "Program(\n  Function(\n    name=\"my_function\",\n    "
           "body=Return(Constant(420))\n  )\n)");
+    CHECK(dump(ast) == "Program([Function(my_function, "
+                       "Return(Constant(420)))])");
+}
+
+TEST_CASE("Parser::parse keeps functions in source order") {
+    Arena arena{};
+    Parser parser("int one(void) { return 1; }\n"
+                  "int two(void) { return -2; }\n"
+                  "int main(void) { return ~3; }",
+                  arena);
+    auto ast = parser.parse();
+    REQUIRE(ast.functions.size() == 3);
+    CHECK(dump(ast) == "Program([Function(one, Return(Constant(1))), "
+                       "Function(two, Return(Unary(Negate, Constant(2)))), "
+                       "Function(main, Return(Unary(Complement, "
+                       "Constant(3))))])");
+    CHECK(pretty(ast) ==
+          "Program(\n  Function(\n    name=\"one\",\n    "
+          "body=Return(Constant(1))\n  ),\n  Function(\n    "
+          "name=\"two\",\n    body=Return(Unary(Negate, Constant(2)))\n  "
+          "),\n  Function(\n    name=\"main\",\n    "
+          "body=Return(Unary(Complement, Constant(3)))\n  )\n)");
+
+    Parser broken("int one(void) { return 1; } int", arena);
+    REQUIRE_THROWS_WITH_AS(broken.parse(), "Missing function name",
+                           SyntaxError);
+}
+
+TEST_CASE("Parser::parse rejects a second definition of a function") {
+    Arena arena{};
+    std::string_view source = "int main(void) { return 1; }\n"
+                              "int two(void) { return 2; }\n"
+                              "int main(void) { return 3; }";
+    Parser parser(source, arena);
+    try {
+        parser.parse();
+        FAIL("expected a SyntaxError");
+    } catch (const SyntaxError &error) {
+        CHECK(std::string(error.what()) == "Redefinition of function main");
+        CHECK(error.offset() == source.rfind("main"));
+    }
+
+    // An error before the second definition is reported first
+    Parser earlier("int main(void) { return 1; }\n"
+                   "int two(void) { return; }\n"
+                   "int main(void) { return 3; }",
+                   arena);
+    REQUIRE_THROWS_WITH_AS(earlier.parse(), "Invalid expression: ;",
+                           SyntaxError);
+}
+
+TEST_CASE("Parser shares structurally equal expressions") {
+    Arena arena{};
+    Parser parser("int one(void) { return ~(-(7)); }\n"
+                  "int two(void) { return ~(-7); }\n"
+                  "int three(void) { return -(-7); }",
+                  arena);
+    auto ast = parser.parse();
+    auto one = ast.functions[0].body.exp;
+    auto two = ast.functions[1].body.exp;
+    auto three = ast.functions[2].body.exp;
+    CHECK(one == two);
+    CHECK(one != three);
+    CHECK(one->unary().exp == three->unary().exp);
+    CHECK(three->unary().exp->unary().exp == one->unary().exp->unary().exp);
+    CHECK(dump(*three) == "Unary(Negate, Unary(Negate, Constant(7)))");
 }
 
 TEST_CASE("Parser::parse_function success") {
-    std::vector<Token> tokens{
-        {Reserved::IntType},    {Identifier{"my_function"}},
-        {Reserved::OpenParen},  {Reserved::Void},
-        {Reserved::CloseParen}, {Reserved::OpenBrace},
-        {Reserved::Return},     {Integer{"420"}},
-        {Reserved::Semicolon},  {Reserved::CloseBrace}};
-    Parser parser(tokens);
+    Arena arena{};
+    Parser parser("int my_function(void) { return 420; }", arena);
     auto fn = parser.parse_function();
-    CHECK(fn->to_string() == "Function(\n  name=\"my_function\",\n  "
-                             "body=Return(Constant(420))\n)");
+    CHECK(pretty(fn) == "Function(\n  name=\"my_function\",\n  "
+                        "body=Return(Constant(420))\n)");
 }
 
 TEST_CASE("Parser::parse_function with missing token") {
-    std::vector<Token> tokens{
-        {Reserved::IntType},   {Identifier{"my_function"}},
-        {Reserved::Void},      {Reserved::CloseParen},
-        {Reserved::OpenBrace}, {Reserved::Return},
-        {Integer{"420"}},      {Reserved::Semicolon},
-        {Reserved::CloseBrace}};
-    Parser parser(tokens);
+    Arena arena{};
+    Parser parser("int my_function void) { return 420; }", arena);
     REQUIRE_THROWS_WITH_AS(parser.parse_function(),
                            "Expected \"(\" but got \"void\"", SyntaxError);
 }
 
 TEST_CASE("Parser::parse_function with invalid name") {
-    std::vector<Token> tokens{{Reserved::IntType},    {Integer{"3"}},
-                              {Reserved::OpenParen},  {Reserved::Void},
-                              {Reserved::CloseParen}, {Reserved::OpenBrace},
-                              {Reserved::Return},     {Integer{"420"}},
-                              {Reserved::Semicolon},  {Reserved::CloseBrace}};
-    Parser parser(tokens);
+    Arena arena{};
+    Parser parser("int 3(void) { return 420; }", arena);
     REQUIRE_THROWS_WITH_AS(parser.parse_function(), "Invalid function name: 3",
                            SyntaxError);
 }
 
 TEST_CASE("Parser::parse_statement success") {
-    std::vector<Token> tokens{
-        {Reserved::Return}, {Integer{"1234"}}, {Reserved::Semicolon}};
-    Parser parser(tokens);
-    auto stmt = parser.parse_statement();
-    CHECK(stmt->to_string() == "Return(Constant(1234))");
+    Arena arena{};
+    Parser parser("return 1234;", arena);
+    CHECK(dump(parser.parse_statement()) == "Return(Constant(1234))");
 }
 
 TEST_CASE("Parser::parse_statement with out of order negation") {
-    std::vector<Token> tokens{{Reserved::Return},
-                              {Integer{"1234"}},
-                              {Reserved::Negate},
-                              {Reserved::Semicolon}};
-    Parser parser(tokens);
+    Arena arena{};
+    Parser parser("return 1234-;", arena);
     REQUIRE_THROWS_WITH_AS(parser.parse_statement(),
                            "Expected \";\" but got \"-\"", SyntaxError);
 }
 
 TEST_CASE("Parser::parse_statement error") {
-    std::vector<Token> tokens{
-        {Identifier{"bork"}}, {Integer{"1234"}}, {Reserved::Semicolon}};
-    Parser parser(tokens);
+    Arena arena{};
+    Parser parser("bork 1234;", arena);
     REQUIRE_THROWS_WITH_AS(parser.parse_statement(),
                            "Expected \"return\" but got \"bork\"", SyntaxError);
 
-    tokens = {{Reserved::Return}, {Integer{"1234"}}};
-    Parser parser2(tokens);
+    Parser parser2("return 1234", arena);
     REQUIRE_THROWS_WITH_AS(parser2.parse_statement(), "Missing \";\"",
                            SyntaxError);
 
-    tokens = {{Reserved::Return}, {Reserved::Semicolon}};
-    Parser parser3(tokens);
+    Parser parser3("return;", arena);
     REQUIRE_THROWS_WITH_AS(parser3.parse_statement(), "Invalid expression: ;",
                            SyntaxError);
 }
 
+TEST_CASE("Parser replays a pre-lexed TokenBuffer") {
+    Arena arena{};
+    auto tokens =
+        tokenize("int main(void) { return ~(-9223372036854775807); }");
+    Parser parser(tokens, arena);
+    CHECK(pretty(parser.parse()) ==
+          "Program(\n  Function(\n    name=\"main\",\n    "
+          "body=Return(Unary(Complement, Unary(Negate, "
+          "Constant(9223372036854775807))))\n  )\n)");
+
+    auto extra = tokenize("int main(void) { return 1; } foo");
+    Parser trailing(extra, arena);
+    REQUIRE_THROWS_WITH_AS(trailing.parse(), "Unexpected token found: foo",
+                           SyntaxError);
+}
+
+TEST_CASE("Parser reads from a SourceStream") {
+    int fds[2];
+    REQUIRE(::pipe(fds) == 0);
+    std::string_view source = "int main(void) {\n    return -(007);\n}\n";
+    REQUIRE(::write(fds[1], source.data(), source.size()) ==
+            static_cast<ssize_t>(source.size()));
+    ::close(fds[1]);
+
+    Arena arena{};
+    SourceStream stream(fds[0], 8);
+    Parser parser(stream, arena);
+    CHECK(pretty(parser.parse()) ==
+          "Program(\n  Function(\n    name=\"main\",\n    "
+          "body=Return(Unary(Negate, Constant(7)))\n  )\n)");
+    ::close(fds[0]);
+}
+
+TEST_CASE("syntax errors record the offending offset") {
+    Arena arena{};
+    Parser parser("int main(void) {\n  return 1234-;\n}", arena);
+    try {
+        parser.parse();
+        FAIL("expected a SyntaxError");
+    } catch (const SyntaxError &error) {
+        REQUIRE(error.offset());
+        CHECK(*error.offset() == 30);
+    }
+
+    Parser truncated("int main(void) { return", arena);
+    try {
+        truncated.parse();
+        FAIL("expected a SyntaxError");
+    } catch (const SyntaxError &error) {
+        CHECK(error.offset() == 23u);
+    }
+}
+
 TEST_CASE("Parser::parse_exp error") {
-    Parser parser(std::vector<Token>({{Identifier{"bark"}}}));
+    Arena arena{};
+    Parser parser("bark", arena);
     REQUIRE_THROWS_WITH_AS(parser.parse_exp(), "Invalid expression: bark",
                            SyntaxError);
 }
 
 TEST_CASE("Parser::parse_exp") {
-    Parser parser(std::vector<Token>({{Integer{"100"}}}));
+    Arena arena{};
+    Parser parser("100", arena);
     auto exp = parser.parse_exp();
-    CHECK(exp->to_string() == "Constant(100)");
+    REQUIRE(exp->is(Exp::Kind::Constant));
+    CHECK(exp->constant().value == 100);
 }
 
 TEST_CASE("expressions have string representations") {
-    Constant exp{"42"};
-    CHECK(exp.to_string() == "Constant(42)");
+    Exp exp = Exp::Constant{42};
+    CHECK(dump(exp) == "Constant(42)");
 }
 
 TEST_CASE("statements have string representations") {
-    Return stmt(std::make_unique<Constant>("23"));
-    CHECK(stmt.to_string() == "Return(Constant(23))");
+    Exp constant = Exp::Constant{23};
+    CHECK(dump(Return{&constant}) == "Return(Constant(23))");
+}
+
+TEST_CASE("AST nodes are compact") {
+    static_assert(sizeof(Exp) == 3 * sizeof(std::int64_t));
+    static_assert(sizeof(Return) == sizeof(const Exp *));
+    Arena arena{};
+    auto *exp = arena.make<Exp>(Exp::Constant{7});
+    auto *unary = arena.make<Exp>(Exp::Unary{UnaryOperator::Complement, exp});
+    auto op = unary->visit([](const auto &node) {
+        if constexpr (std::is_same_v<decltype(node), const Exp::Unary &>) {
+            return node.op;
+        }
+        return UnaryOperator::Negate;
+    });
+    CHECK(op == UnaryOperator::Complement);
 }
 } // namespace Ast
@@ -1,123 +1,123 @@
 #pragma once
 
+#include <cassert>
 #include <format>
-#include <memory>
-
+#include <memory_resource>
+#include <ostream>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <utility>
+#include <variant>
+#include <vector>
+
+#include "arena.h"
+#include "ast_nodes.h"
+#include "grammar_table.h"
 #include "lexer.h"
 
 namespace Ast {
-class Exp {
-  public:
-    virtual ~Exp() = default;
-    virtual std::string const to_string() = 0;
-};
-
-class Constant : public Exp {
-    std::string _value; // this is constructing a new string from a view
-
-  public:
-    Constant(std::string_view v) : _value(v) {}
-
-    auto value() const { return _value; }
-    std::string const to_string() override {
-        return std::format("Constant({})", _value);
-    }
-};
-
-class UnaryOperator {
-  public:
-    virtual ~UnaryOperator() = default;
-    virtual std::string const to_string() = 0;
-};
-
-class Complement : public UnaryOperator {
-    std::string const to_string() override { return "Complement"; }
-};
-
-class Negate : public UnaryOperator {
-    std::string const to_string() override { return "Negate"; }
-};
-
-class Unary : public Exp {
-    std::unique_ptr<UnaryOperator> _op;
-    std::unique_ptr<Exp> _exp;
-
-  public:
-    Unary(std::unique_ptr<UnaryOperator> op, std::unique_ptr<Exp> exp)
-        : _op(std::move(op)), _exp(std::move(exp)) {}
-
-    std::unique_ptr<UnaryOperator> op() { return std::move(_op); };
-    std::unique_ptr<Exp> exp() { return std::move(_exp); };
-
-    std::string const to_string() override {
-        return std::format("{}({})", _op->to_string(), _exp->to_string());
-    }
-};
-
-class Statement {
-  public:
-    virtual ~Statement() = default;
-    virtual std::string const to_string() = 0;
-};
-
-class Return : public Statement {
-    std::unique_ptr<Exp> _exp;
-
-  public:
-    Return(auto e) : _exp(std::move(e)) {}
-
-    auto exp() { return std::move(_exp); }
-    std::string const to_string() override {
-        return std::format("Return({})", _exp->to_string());
-    }
-};
-
-class Function {
-    std::string _name{};
-    std::unique_ptr<Statement> _body;
-
-  public:
-    Function(auto n, auto b) : _name(n), _body(std::move(b)) {}
-
-    std::string to_string(int indent = 0) {
-        int next_lvl = indent + 2;
-        return std::format(
-            "Function(\n{:<{}}name=\"{}\",\n{:<{}}body={}\n{:<{}})", "",
-            next_lvl, _name, "", next_lvl, _body->to_string(), "", indent);
+// Multi-line layout used by --parse
+void pretty_print(std::ostream &, const Function &, int indent = 0);
+void pretty_print(std::ostream &, const Program &);
+
+// A second function named `name`, defined at `offset`. C allows one
+// definition per name, and the linker would reject the program.
+SyntaxError redefinition(Symbol name, std::uint32_t offset);
+
+// Functions parsed so far, in reverse
+using FunctionList = std::pmr::vector<Function>;
+
+// Values left on the parser's stack: matched tokens and finished nodes
+using SemanticValue = std::variant<Token, const Exp *, UnaryOperator, Return,
+                                   Function, FunctionList, Program>;
+
+// Predictive parser driven by the LL(1) table generated from grammar.ebnf.
+// Pulls tokens from a Lexer with one token of lookahead, so memory use does
+// not grow with the length of the token stream. The lexer reads either a
+// whole source buffer or a SourceStream. Alternatively replays a TokenBuffer
+// that was lexed up front, e.g. in parallel.
+class Parser {
+    Arena &_arena;
+    Lexer _lexer;
+    const TokenBuffer *_tokens{nullptr};
+    std::size_t _replayed{0};
+    std::size_t _end{0};
+    Token _next{};
+
+    Token pull() {
+        if (!_tokens) {
+            return _lexer.next();
+        }
+        if (_replayed < _end) {
+            return (*_tokens)[_replayed++];
+        }
+        auto eof = _end < _tokens->size() ? (*_tokens)[_end].offset
+                                          : _tokens->source().size();
+        return {TokenKind::Eof, static_cast<std::uint32_t>(eof)};
     }
-
-    std::unique_ptr<Statement> body() { return std::move(_body); }
-    std::string name() { return _name; }
-};
-
-class Program {
-    std::unique_ptr<Function> _fn;
-
-  public:
-    Program() = default;
-    Program(auto fn) : _fn(std::move(fn)) {}
-
-    std::unique_ptr<Function> &fn() { return _fn; }
-
-    std::string to_string() {
-        return std::format("Program(\n  {}\n)", _fn->to_string(2));
+    Token take() { return std::exchange(_next, pull()); }
+    std::int64_t value(Token token) const {
+        return _tokens ? _tokens->value(token) : _lexer.value(token);
     }
-};
-
-class Parser {
-    std::vector<Token> _tokens;
-    size_t _current_token{0};
-
-    void expect(std::string);
-    Token &take_token();
+    std::string to_str(Token token) const { return _lexer.to_str(token); }
+    Token expect(TokenKind);
+    Token match(TokenKind);
+    [[noreturn]] void unexpected(Grammar::Nonterminal);
+
+    // Structurally equal expressions are allocated once and shared, so the
+    // AST is a DAG. Operands are shared before their parents are built, so
+    // a node is identified by its own fields and its operand's address.
+    struct ExpKey {
+        Exp::Kind kind{};
+        UnaryOperator op{};
+        std::int64_t value{}; // the constant, or the operand's address
+        bool operator==(const ExpKey &) const = default;
+    };
+    struct ExpKeyHash {
+        std::size_t operator()(const ExpKey &key) const noexcept {
+            auto tag = static_cast<std::size_t>(key.kind) << 8 |
+                       static_cast<std::size_t>(key.op);
+            return std::hash<std::int64_t>{}(key.value) * 31 + tag;
+        }
+    };
+    std::unordered_map<ExpKey, const Exp *, ExpKeyHash> _exps{};
+    const Exp *make_exp(const Exp &);
+
+    // Names of the functions this parser has built
+    std::unordered_set<Symbol> _defined{};
+
+    SemanticValue parse_rule(Grammar::Nonterminal);
+    void reduce(Grammar::Production, std::vector<SemanticValue> &);
 
   public:
-    Parser(auto t) : _tokens(t) {}
+    // Nodes are allocated in `arena`, which must outlive them
+    Parser(std::string_view source, Arena &arena)
+        : _arena(arena), _lexer(source), _next(pull()) {}
+    // The stream must outlive the parser
+    Parser(SourceStream &stream, Arena &arena)
+        : _arena(arena), _lexer(stream), _next(pull()) {}
+    // The buffer must outlive the parser
+    Parser(const TokenBuffer &tokens, Arena &arena)
+        : Parser(tokens, 0, tokens.size(), arena) {}
+    // Replays only tokens [first, last), as if the input ended there
+    Parser(const TokenBuffer &tokens, std::size_t first, std::size_t last,
+           Arena &arena)
+        : _arena(arena), _lexer(tokens.source()), _tokens(&tokens),
+          _replayed(first), _end(last), _next(pull()) {}
 
     Program parse();
-    std::unique_ptr<Exp> parse_exp();
-    std::unique_ptr<Statement> parse_statement();
-    std::unique_ptr<Function> parse_function();
-    std::unique_ptr<UnaryOperator> parse_unop();
+    const Exp *parse_exp();
+    Return parse_statement();
+    Function parse_function();
+    // Throws what parse() would if the next token cannot follow a function
+    void expect_next_function();
+
+    [[nodiscard]] bool at_end() const { return _next.is(TokenKind::Eof); }
+    // Index in the replayed buffer of the next token to be parsed
+    [[nodiscard]] std::size_t position() const {
+        assert(_tokens);
+        return at_end() ? _replayed : _replayed - 1;
+    }
 };
 } // namespace Ast
@@ -0,0 +1,102 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+#include <utility>
+
+// Perfect hash over a fixed set of spellings, built at compile time
+// with hash-and-displace: keys are grouped into buckets by one hash, then each
+// bucket gets a seed that sends all of its keys to free slots. A lookup is two
+// hashes and one string compare regardless of how many keys there are.
+template <typename Key, std::size_t N> class PerfectHash {
+    static constexpr std::size_t SLOTS = std::bit_ceil(2 * N);
+    static constexpr std::size_t BUCKETS = std::bit_ceil(N / 2 + 1);
+
+    std::array<std::uint16_t, BUCKETS> _seeds{};
+    std::array<std::pair<Key, std::string_view>, SLOTS> _slots{};
+
+    [[nodiscard]] static constexpr std::uint32_t hash(std::string_view word,
+                                                      std::uint32_t seed) {
+        std::uint32_t h = 2166136261u ^ (seed * 0x9e3779b9u);
+        for (char ch : word) {
+            h = (h ^ static_cast<unsigned char>(ch)) * 16777619u;
+        }
+        h ^= h >> 15;
+        h *= 0x2c1b3c6du;
+        return h ^ (h >> 12);
+    }
+
+  public:
+    constexpr explicit PerfectHash(
+        const std::array<std::pair<Key, std::string_view>, N> &entries) {
+        // Assign every slot up front; GCC 12 rejects reads of elements that
+        // were only value-initialized by the member initializer
+        _slots.fill({Key{}, std::string_view{}});
+        std::array<std::size_t, N> bucket_of{};
+        std::array<std::size_t, BUCKETS> bucket_size{};
+        std::size_t largest{0};
+        for (std::size_t i = 0; i < N; i++) {
+            bucket_of[i] = hash(entries[i].second, 0) & (BUCKETS - 1);
+            largest = std::max(largest, ++bucket_size[bucket_of[i]]);
+        }
+
+        // Place crowded buckets first while the table is still empty
+        std::array<bool, SLOTS> used{};
+        for (std::size_t size = largest; size > 0; size--) {
+            for (std::size_t bucket = 0; bucket < BUCKETS; bucket++) {
+                if (bucket_size[bucket] == size) {
+                    place(entries, bucket_of, bucket, used);
+                }
+            }
+        }
+    }
+
+    [[nodiscard]] constexpr Key find(std::string_view word,
+                                     Key missing) const {
+        auto seed = _seeds[hash(word, 0) & (BUCKETS - 1)];
+        const auto &slot = _slots[hash(word, seed) & (SLOTS - 1)];
+        return !word.empty() && slot.second == word ? slot.first : missing;
+    }
+
+  private:
+    constexpr void
+    place(const std::array<std::pair<Key, std::string_view>, N> &entries,
+          const std::array<std::size_t, N> &bucket_of, std::size_t bucket,
+          std::array<bool, SLOTS> &used) {
+        for (std::uint32_t seed = 1; seed <= UINT16_MAX; seed++) {
+            std::array<std::size_t, N> taken{};
+            std::size_t count{0};
+            bool fits = true;
+            for (std::size_t i = 0; i < N && fits; i++) {
+                if (bucket_of[i] != bucket) {
+                    continue;
+                }
+                auto slot = hash(entries[i].second, seed) & (SLOTS - 1);
+                fits = !used[slot];
+                for (std::size_t j = 0; j < count && fits; j++) {
+                    fits = taken[j] != slot;
+                }
+                taken[count++] = slot;
+            }
+            if (!fits) {
+                continue;
+            }
+
+            _seeds[bucket] = static_cast<std::uint16_t>(seed);
+            count = 0;
+            for (std::size_t i = 0; i < N; i++) {
+                if (bucket_of[i] == bucket) {
+                    used[taken[count]] = true;
+                    _slots[taken[count++]] = entries[i];
+                }
+            }
+            return;
+        }
+        // Only reachable with duplicate spellings; fails constant evaluation
+        throw "PerfectHash: no seed separates this bucket";
+    }
+};
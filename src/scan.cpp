@@ -0,0 +1,238 @@
+#include <array>
+#include <cstdint>
+#include <string>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define CCX_SCAN_X86 1
+#endif
+
+#include "doctest.h"
+#include "scan.h"
+
+namespace Scan {
+namespace {
+enum class Class { Space, Ident, Digit };
+
+template <Class C> constexpr bool in_class(char ch) {
+    if constexpr (C == Class::Space) {
+        return is_space(ch);
+    } else if constexpr (C == Class::Ident) {
+        return is_ident(ch);
+    } else {
+        return is_digit(ch);
+    }
+}
+
+template <Class C>
+std::size_t scan_scalar(std::string_view source, std::size_t pos) {
+    while (pos < source.size() && in_class<C>(source[pos])) {
+        pos++;
+    }
+    return pos;
+}
+
+#ifdef CCX_SCAN_X86
+// Signed byte compares are enough for these ranges: every class member is
+// ASCII, and bytes >= 0x80 compare as negative so they fall outside all of
+// them.
+inline __m128i in_range(__m128i bytes, char lo, char hi) {
+    return _mm_and_si128(_mm_cmpgt_epi8(bytes, _mm_set1_epi8(lo - 1)),
+                         _mm_cmpgt_epi8(_mm_set1_epi8(hi + 1), bytes));
+}
+
+template <Class C> inline __m128i classify(__m128i bytes) {
+    if constexpr (C == Class::Space) {
+        return _mm_or_si128(_mm_cmpeq_epi8(bytes, _mm_set1_epi8(' ')),
+                            in_range(bytes, '\t', '\r'));
+    } else if constexpr (C == Class::Ident) {
+        // Setting bit 5 folds upper case onto lower case
+        auto folded = _mm_or_si128(bytes, _mm_set1_epi8(0x20));
+        auto alpha = in_range(folded, 'a', 'z');
+        auto under = _mm_cmpeq_epi8(bytes, _mm_set1_epi8('_'));
+        return _mm_or_si128(_mm_or_si128(alpha, under),
+                            in_range(bytes, '0', '9'));
+    } else {
+        return in_range(bytes, '0', '9');
+    }
+}
+
+template <Class C>
+std::size_t scan_sse2(std::string_view source, std::size_t pos) {
+    const char *data = source.data();
+    while (pos + 16 <= source.size()) {
+        auto bytes = _mm_loadu_si128(
+            reinterpret_cast<const __m128i *>(data + pos));
+        auto outside = ~_mm_movemask_epi8(classify<C>(bytes)) & 0xffff;
+        if (outside) {
+            return pos + __builtin_ctz(outside);
+        }
+        pos += 16;
+    }
+    return scan_scalar<C>(source, pos);
+}
+
+__attribute__((target("avx2"))) inline __m256i in_range(__m256i bytes,
+                                                        char lo, char hi) {
+    return _mm256_and_si256(
+        _mm256_cmpgt_epi8(bytes, _mm256_set1_epi8(lo - 1)),
+        _mm256_cmpgt_epi8(_mm256_set1_epi8(hi + 1), bytes));
+}
+
+template <Class C>
+__attribute__((target("avx2"))) inline __m256i classify(__m256i bytes) {
+    if constexpr (C == Class::Space) {
+        return _mm256_or_si256(
+            _mm256_cmpeq_epi8(bytes, _mm256_set1_epi8(' ')),
+            in_range(bytes, '\t', '\r'));
+    } else if constexpr (C == Class::Ident) {
+        auto folded = _mm256_or_si256(bytes, _mm256_set1_epi8(0x20));
+        auto alpha = in_range(folded, 'a', 'z');
+        auto under = _mm256_cmpeq_epi8(bytes, _mm256_set1_epi8('_'));
+        return _mm256_or_si256(_mm256_or_si256(alpha, under),
+                               in_range(bytes, '0', '9'));
+    } else {
+        return in_range(bytes, '0', '9');
+    }
+}
+
+template <Class C>
+__attribute__((target("avx2"))) std::size_t scan_avx2(std::string_view source,
+                                                      std::size_t pos) {
+    const char *data = source.data();
+    while (pos + 32 <= source.size()) {
+        auto bytes = _mm256_loadu_si256(
+            reinterpret_cast<const __m256i *>(data + pos));
+        auto outside = ~static_cast<std::uint32_t>(
+            _mm256_movemask_epi8(classify<C>(bytes)));
+        if (outside) {
+            return pos + __builtin_ctz(outside);
+        }
+        pos += 32;
+    }
+    return scan_sse2<C>(source, pos);
+}
+#endif
+
+using ScanFn = std::size_t (*)(std::string_view, std::size_t);
+
+struct Scanners {
+    ScanFn space;
+    ScanFn ident;
+    ScanFn digit;
+};
+
+constexpr Scanners SCALAR{scan_scalar<Class::Space>,
+                          scan_scalar<Class::Ident>,
+                          scan_scalar<Class::Digit>};
+#ifdef CCX_SCAN_X86
+constexpr Scanners SSE2{scan_sse2<Class::Space>, scan_sse2<Class::Ident>,
+                        scan_sse2<Class::Digit>};
+constexpr Scanners AVX2{scan_avx2<Class::Space>, scan_avx2<Class::Ident>,
+                        scan_avx2<Class::Digit>};
+#endif
+
+const Scanners &scanners_for(Impl impl) {
+#ifdef CCX_SCAN_X86
+    switch (impl) {
+    case Impl::AVX2:
+        return AVX2;
+    case Impl::SSE2:
+        return SSE2;
+    default:
+        break;
+    }
+#endif
+    return SCALAR;
+}
+
+Impl _impl = best_impl();
+const Scanners *_scanners = &scanners_for(_impl);
+} // namespace
+
+Impl best_impl() {
+#ifdef CCX_SCAN_X86
+    // Needed because this also runs during static initialization
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) {
+        return Impl::AVX2;
+    }
+    if (__builtin_cpu_supports("sse2")) {
+        return Impl::SSE2;
+    }
+#endif
+    return Impl::Scalar;
+}
+
+bool supported(Impl impl) {
+    switch (impl) {
+    case Impl::Scalar:
+        return true;
+    case Impl::SSE2:
+        return best_impl() != Impl::Scalar;
+    case Impl::AVX2:
+        return best_impl() == Impl::AVX2;
+    }
+    return false;
+}
+
+void use_impl(Impl impl) {
+    if (!supported(impl)) {
+        impl = best_impl();
+    }
+    _impl = impl;
+    _scanners = &scanners_for(impl);
+}
+
+Impl current_impl() { return _impl; }
+
+std::size_t skip_whitespace(std::string_view source, std::size_t pos) {
+    return _scanners->space(source, pos);
+}
+
+std::size_t identifier_end(std::string_view source, std::size_t pos) {
+    return _scanners->ident(source, pos);
+}
+
+std::size_t digits_end(std::string_view source, std::size_t pos) {
+    return _scanners->digit(source, pos);
+}
+} // namespace Scan
+
+//// TESTS ////
+
+TEST_CASE("Scan implementations agree on every position") {
+    std::string source{};
+    for (int i = 0; i < 8; i++) {
+        source += "int  foo_Bar9\t\n 0123456789 x\r\v\f";
+        source += std::string(40, ' ') + std::string(37, 'a') + "-~()";
+        source += std::string(33, '7') + "\x80\xff" + "_z_Z";
+    }
+
+    auto previous = Scan::current_impl();
+    for (auto impl : {Scan::Impl::SSE2, Scan::Impl::AVX2}) {
+        if (!Scan::supported(impl)) {
+            continue;
+        }
+        for (std::size_t pos = 0; pos <= source.size(); pos++) {
+            Scan::use_impl(Scan::Impl::Scalar);
+            auto space = Scan::skip_whitespace(source, pos);
+            auto ident = Scan::identifier_end(source, pos);
+            auto digit = Scan::digits_end(source, pos);
+
+            Scan::use_impl(impl);
+            CHECK(Scan::skip_whitespace(source, pos) == space);
+            CHECK(Scan::identifier_end(source, pos) == ident);
+            CHECK(Scan::digits_end(source, pos) == digit);
+        }
+    }
+    Scan::use_impl(previous);
+}
+
+TEST_CASE("Scan stops at the end of the run") {
+    CHECK(Scan::skip_whitespace("  \t\n x", 0) == 5);
+    CHECK(Scan::identifier_end("main(void)", 0) == 4);
+    CHECK(Scan::digits_end("2246;", 0) == 4);
+    CHECK(Scan::digits_end("2246", 0) == 4);
+    CHECK(Scan::skip_whitespace("", 0) == 0);
+}
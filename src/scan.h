@@ -0,0 +1,42 @@
+#pragma once
+
+#include <cstddef>
+#include <string_view>
+
+// Character-class scanning for the lexer. Classes are plain ASCII, matching C
+// source rules rather than the current locale.
+namespace Scan {
+[[nodiscard]] constexpr bool is_space(char ch) {
+    return ch == ' ' || (ch >= '\t' && ch <= '\r');
+}
+
+[[nodiscard]] constexpr bool is_digit(char ch) {
+    return ch >= '0' && ch <= '9';
+}
+
+[[nodiscard]] constexpr bool is_ident_start(char ch) {
+    return (ch >= 'a' && ch <= 'z') || (ch >= 'A' && ch <= 'Z') || ch == '_';
+}
+
+[[nodiscard]] constexpr bool is_ident(char ch) {
+    return is_ident_start(ch) || is_digit(ch);
+}
+
+enum class Impl { Scalar, SSE2, AVX2 };
+
+// The widest implementation supported by the running CPU
+Impl best_impl();
+bool supported(Impl);
+
+// Selects the implementation used by the functions below. Defaults to
+// best_impl(); the scalar path is kept for targets without SSE2 and for
+// benchmarking.
+void use_impl(Impl);
+Impl current_impl();
+
+// Each returns the index of the first byte at or after `pos` outside the class,
+// or source.size() if the run reaches the end.
+std::size_t skip_whitespace(std::string_view source, std::size_t pos);
+std::size_t identifier_end(std::string_view source, std::size_t pos);
+std::size_t digits_end(std::string_view source, std::size_t pos);
+} // namespace Scan
@@ -0,0 +1,72 @@
+#include <filesystem>
+#include <fstream>
+#include <string>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "doctest.h"
+#include "source.h"
+
+SourceFile::SourceFile(const std::string &path) {
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        return;
+    }
+
+    struct stat info {};
+    if (::fstat(fd, &info) == 0) {
+        _size = static_cast<std::size_t>(info.st_size);
+        if (_size == 0) {
+            // mmap rejects zero-length mappings; an empty file is still valid
+            _open = true;
+        } else {
+            void *mapping =
+                ::mmap(nullptr, _size, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (mapping != MAP_FAILED) {
+                ::madvise(mapping, _size, MADV_SEQUENTIAL);
+                _data = static_cast<const char *>(mapping);
+                _open = true;
+            } else {
+                _size = 0;
+            }
+        }
+    }
+    ::close(fd);
+}
+
+SourceFile::~SourceFile() {
+    if (_data) {
+        ::munmap(const_cast<char *>(_data), _size);
+    }
+}
+
+//// TESTS ////
+
+TEST_CASE("SourceFile maps file contents") {
+    auto path = std::filesystem::temp_directory_path() / "ccx_source_test.c";
+    {
+        std::ofstream out(path);
+        out << "int main(void) { return 2; }";
+    }
+
+    SourceFile source(path.string());
+    REQUIRE(source);
+    CHECK(source.text() == "int main(void) { return 2; }");
+    std::filesystem::remove(path);
+}
+
+TEST_CASE("SourceFile handles empty and missing files") {
+    auto path = std::filesystem::temp_directory_path() / "ccx_empty_test.c";
+    { std::ofstream out(path); }
+
+    SourceFile empty(path.string());
+    CHECK(empty);
+    CHECK(empty.text().empty());
+    std::filesystem::remove(path);
+
+    SourceFile missing(path.string());
+    CHECK_FALSE(missing);
+}
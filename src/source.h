@@ -0,0 +1,23 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+#include <string_view>
+
+// Read-only memory mapping of a source file. Tokens produced from text() are
+// views into the mapping, so it must outlive them.
+class SourceFile {
+    const char *_data{nullptr};
+    std::size_t _size{};
+    bool _open{false};
+
+  public:
+    explicit SourceFile(const std::string &path);
+    ~SourceFile();
+
+    SourceFile(const SourceFile &) = delete;
+    SourceFile &operator=(const SourceFile &) = delete;
+
+    explicit operator bool() const noexcept { return _open; }
+    std::string_view text() const noexcept { return {_data, _size}; }
+};
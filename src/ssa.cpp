@@ -0,0 +1,256 @@
+#include <cassert>
+#include <cstdint>
+#include <limits>
+#include <stdexcept>
+#include <vector>
+
+#include "doctest.h"
+#include "ssa.h"
+
+namespace Tacky {
+namespace {
+constexpr auto NONE = std::numeric_limits<std::uint32_t>::max();
+constexpr auto NEVER = std::numeric_limits<std::size_t>::max();
+} // namespace
+
+bool well_formed(const Function &fn) {
+    auto valid = [&](Val val) {
+        return is_constant(val) ? index(val) < fn.constants.size()
+                                : index(val) < fn.registers;
+    };
+    for (const auto &instr : fn.body) {
+        if (instr.is(Instruction::Kind::Return)) {
+            if (!valid(instr.return_().val)) {
+                return false;
+            }
+            continue;
+        }
+        const auto &unary = instr.unary();
+        if (!valid(unary.src) || !valid(unary.dst) ||
+            is_constant(unary.dst)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// A register read before its assignment would also break single
+// assignment once it is given the value it has on entry
+bool is_ssa(const Function &fn) {
+    enum class Seen : std::uint8_t { No, Read, Assigned };
+    std::vector<Seen> seen(fn.registers, Seen::No);
+    auto read = [&](Val val) {
+        if (!is_constant(val) && seen[index(val)] == Seen::No) {
+            seen[index(val)] = Seen::Read;
+        }
+    };
+    for (const auto &instr : fn.body) {
+        if (instr.is(Instruction::Kind::Return)) {
+            read(instr.return_().val);
+            continue;
+        }
+        const auto &unary = instr.unary();
+        read(unary.src);
+        if (seen[index(unary.dst)] != Seen::No) {
+            return false;
+        }
+        seen[index(unary.dst)] = Seen::Assigned;
+    }
+    return true;
+}
+
+Function to_ssa(const Function &fn, Arena &arena) {
+    assert(well_formed(fn));
+    std::vector<std::uint32_t> current(fn.registers, NONE);
+    std::uint32_t registers = 0;
+    auto fresh = [&] {
+        if (registers == CONSTANT_BIT) {
+            throw std::length_error("Too many temporaries in one function");
+        }
+        return reg(registers++);
+    };
+    auto rename = [&](Val val) {
+        if (is_constant(val)) {
+            return val;
+        }
+        auto &version = current[index(val)];
+        if (version == NONE) {
+            version = index(fresh());
+        }
+        return reg(version);
+    };
+
+    std::pmr::vector<Instruction> body(fn.body.begin(), fn.body.end(),
+                                       &arena);
+    for (auto &instr : body) {
+        if (instr.is(Instruction::Kind::Return)) {
+            instr.return_().val = rename(instr.return_().val);
+            continue;
+        }
+        auto &unary = instr.unary();
+        unary.src = rename(unary.src);
+        auto original = unary.dst;
+        unary.dst = fresh();
+        current[index(original)] = index(unary.dst);
+    }
+    return Function{fn.name, arena.adopt(body), fn.constants, registers};
+}
+
+Function from_ssa(const Function &fn, Arena &arena) {
+    assert(well_formed(fn) && is_ssa(fn));
+    // Index of the last instruction reading each register
+    std::vector<std::size_t> last_use(fn.registers, NEVER);
+    for (std::size_t i = 0; i < fn.body.size(); i++) {
+        const auto &instr = fn.body[i];
+        auto val = instr.is(Instruction::Kind::Return) ? instr.return_().val
+                                                       : instr.unary().src;
+        if (!is_constant(val)) {
+            last_use[index(val)] = i;
+        }
+    }
+
+    std::vector<std::uint32_t> assigned(fn.registers, NONE);
+    std::vector<std::uint32_t> released{};
+    std::uint32_t registers = 0;
+    auto allocate = [&](Val val) {
+        auto &slot = assigned[index(val)];
+        if (slot == NONE) {
+            if (released.empty()) {
+                slot = registers++;
+            } else {
+                slot = released.back();
+                released.pop_back();
+            }
+        }
+        return reg(slot);
+    };
+    auto release = [&](Val val) { released.push_back(assigned[index(val)]); };
+
+    std::pmr::vector<Instruction> body(fn.body.begin(), fn.body.end(),
+                                       &arena);
+    for (std::size_t i = 0; i < body.size(); i++) {
+        auto &instr = body[i];
+        if (instr.is(Instruction::Kind::Return)) {
+            auto &val = instr.return_().val;
+            if (!is_constant(val)) {
+                val = allocate(val);
+            }
+            continue;
+        }
+        auto &unary = instr.unary();
+        auto src = unary.src;
+        auto dst = unary.dst;
+        if (!is_constant(src)) {
+            unary.src = allocate(src);
+            if (last_use[index(src)] == i) {
+                release(src);
+            }
+        }
+        unary.dst = allocate(dst);
+        if (last_use[index(dst)] == NEVER) {
+            release(dst);
+        }
+    }
+    return Function{fn.name, arena.adopt(body), fn.constants, registers};
+}
+} // namespace Tacky
+
+//// TESTS ////
+
+namespace {
+using Tacky::Instruction;
+using Tacky::UnaryOperator;
+
+std::string listing(const Tacky::Function &fn) {
+    std::string out{};
+    for (const auto &instr : fn.body) {
+        out += (out.empty() ? "" : "; ") + to_string(fn, instr);
+    }
+    return out;
+}
+
+Tacky::Function lower(std::string_view source, Arena &arena) {
+    Ast::Parser parser(source, arena);
+    Tacky::Generator gen(arena);
+    return gen.convert_function(parser.parse().functions[0]);
+}
+} // namespace
+
+TEST_CASE("to_ssa renames registers assigned more than once") {
+    using Tacky::reg;
+    std::vector<Instruction> body{
+        Instruction::Unary{UnaryOperator::Negate, reg(0), reg(1)},
+        Instruction::Unary{UnaryOperator::Complement, reg(1), reg(1)},
+        Instruction::Unary{UnaryOperator::Negate, reg(1), reg(0)},
+        Instruction::Return{reg(0)},
+    };
+    Tacky::Function fn{intern("f"), body, {}, 2};
+    CHECK(Tacky::well_formed(fn));
+    CHECK_FALSE(Tacky::is_ssa(fn));
+
+    Arena arena{};
+    auto ssa = Tacky::to_ssa(fn, arena);
+    CHECK(Tacky::is_ssa(ssa));
+    CHECK(ssa.registers == 4);
+    // Var(f.0) is the value register 0 had on entry
+    CHECK(listing(ssa) == "Unary(Negate, Var(f.0), Var(f.1)); "
+                          "Unary(Complement, Var(f.1), Var(f.2)); "
+                          "Unary(Negate, Var(f.2), Var(f.3)); "
+                          "Return(Var(f.3))");
+}
+
+TEST_CASE("well_formed rejects operands out of range") {
+    using Tacky::reg;
+    std::vector<Instruction> body{Instruction::Return{reg(1)}};
+    CHECK_FALSE(Tacky::well_formed({intern("f"), body, {}, 1}));
+    std::vector<Instruction> pooled{Instruction::Return{Tacky::pooled(0)}};
+    CHECK_FALSE(Tacky::well_formed({intern("f"), pooled, {}, 0}));
+}
+
+TEST_CASE("from_ssa reuses registers once their value is dead") {
+    Arena arena{};
+    auto fn = lower("int main(void) { return ~(-(~(-(~1)))); }", arena);
+    CHECK(fn.registers == 5);
+    auto out = Tacky::from_ssa(fn, arena);
+    CHECK(out.registers == 1);
+    CHECK(listing(out) == "Unary(Complement, Constant(1), Var(main.0)); "
+                          "Unary(Negate, Var(main.0), Var(main.0)); "
+                          "Unary(Complement, Var(main.0), Var(main.0)); "
+                          "Unary(Negate, Var(main.0), Var(main.0)); "
+                          "Unary(Complement, Var(main.0), Var(main.0)); "
+                          "Return(Var(main.0))");
+}
+
+TEST_CASE("from_ssa keeps values apart while both are live") {
+    using Tacky::reg;
+    std::vector<Instruction> body{
+        Instruction::Unary{UnaryOperator::Negate, reg(0), reg(1)},
+        Instruction::Unary{UnaryOperator::Negate, reg(1), reg(2)},
+        Instruction::Unary{UnaryOperator::Negate, reg(2), reg(3)}, // dead
+        Instruction::Unary{UnaryOperator::Complement, reg(1), reg(4)},
+        Instruction::Return{reg(4)},
+    };
+    Tacky::Function fn{intern("f"), body, {}, 5};
+    REQUIRE(Tacky::is_ssa(fn));
+
+    Arena arena{};
+    auto out = Tacky::from_ssa(fn, arena);
+    CHECK(out.registers == 2);
+    CHECK(listing(out) == "Unary(Negate, Var(f.0), Var(f.0)); "
+                          "Unary(Negate, Var(f.0), Var(f.1)); "
+                          "Unary(Negate, Var(f.1), Var(f.1)); "
+                          "Unary(Complement, Var(f.0), Var(f.0)); "
+                          "Return(Var(f.0))");
+}
+
+TEST_CASE("from_ssa sizes deep chains by live values") {
+    std::string source = "int main(void) { return ";
+    for (int i = 0; i < 10000; i++) {
+        source += i % 2 ? "-" : "~";
+    }
+    source += "1; }";
+    Arena arena{};
+    auto fn = lower(source, arena);
+    CHECK(fn.registers == 10000);
+    CHECK(Tacky::from_ssa(fn, arena).registers == 1);
+}
@@ -0,0 +1,29 @@
+#pragma once
+
+#include "arena.h"
+#include "tacky.h"
+
+// TACKY functions are a single basic block whose registers are temporaries,
+// so SSA needs neither phis nor a dominator tree: the entry block dominates
+// everything, and no local lives in memory for mem2reg to promote. What is
+// left is renaming on the way in and sharing registers on the way out.
+namespace Tacky {
+// Whether every operand names a register below `fn.registers` or an entry
+// of the constant pool, and every destination is a register
+bool well_formed(const Function &fn);
+
+// Whether no register is assigned more than once
+bool is_ssa(const Function &fn);
+
+// Gives every assignment a fresh register and points each use at the latest
+// one. A register read before any assignment gets a register of its own.
+// `fn` must be well formed.
+Function to_ssa(const Function &fn, Arena &arena);
+
+// Renumbers registers so that values whose lifetimes do not overlap share
+// one, in a single forward scan: a result reuses the register of an operand
+// read for the last time by the same instruction. Asm::Generator gives each
+// register a stack slot, so this sizes the frame by the values live at once
+// rather than by the instruction count. The result is no longer in SSA form.
+Function from_ssa(const Function &fn, Arena &arena);
+} // namespace Tacky
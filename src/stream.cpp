@@ -0,0 +1,154 @@
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <string>
+#include <system_error>
+
+#include <unistd.h>
+
+#include "doctest.h"
+#include "lexer.h"
+#include "stream.h"
+
+namespace {
+// Location reached after reading `text` from `start`
+Location advance(Location start, std::string_view text) {
+    auto newlines = static_cast<std::uint32_t>(
+        std::count(text.begin(), text.end(), '\n'));
+    if (newlines == 0) {
+        return {start.line, start.column +
+                                static_cast<std::uint32_t>(text.size())};
+    }
+    auto line_start = text.rfind('\n') + 1;
+    return {start.line + newlines,
+            static_cast<std::uint32_t>(text.size() - line_start) + 1};
+}
+} // namespace
+
+SourceStream::SourceStream(int fd, std::size_t capacity)
+    : _fd(fd), _buffer(std::make_unique<char[]>(capacity)),
+      _capacity(capacity) {
+    refill(0);
+}
+
+std::size_t SourceStream::refill(std::size_t consumed) {
+    consumed = std::min(consumed, _size);
+    _base_location = advance(_base_location, window().substr(0, consumed));
+    _base += consumed;
+    _size -= consumed;
+    std::memmove(_buffer.get(), _buffer.get() + consumed, _size);
+
+    std::size_t read_total{0};
+    while (!_exhausted && _size < _capacity) {
+        auto count = ::read(_fd, _buffer.get() + _size, _capacity - _size);
+        if (count < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            throw std::system_error(errno, std::generic_category(),
+                                    "Failed to read source");
+        }
+        _exhausted = count == 0;
+        _size += static_cast<std::size_t>(count);
+        read_total += static_cast<std::size_t>(count);
+    }
+    return read_total;
+}
+
+Location SourceStream::locate(std::uint64_t offset) const {
+    if (offset < _base) {
+        return _base_location;
+    }
+    auto length = std::min<std::uint64_t>(offset - _base, _size);
+    return advance(_base_location, window().substr(0, length));
+}
+
+//// TESTS ////
+
+namespace {
+// Read end of a pipe that yields `text` and then ends
+int pipe_source(std::string_view text) {
+    int fds[2];
+    REQUIRE(::pipe(fds) == 0);
+    REQUIRE(::write(fds[1], text.data(), text.size()) ==
+            static_cast<ssize_t>(text.size()));
+    ::close(fds[1]);
+    return fds[0];
+}
+} // namespace
+
+TEST_CASE("SourceStream fills a fixed window") {
+    int fd = pipe_source("int main(void)");
+    SourceStream stream(fd, 8);
+    CHECK(stream.window() == "int main");
+    CHECK_FALSE(stream.exhausted());
+
+    CHECK(stream.refill(4) == 4);
+    CHECK(stream.base() == 4);
+    CHECK(stream.window() == "main(voi");
+
+    CHECK(stream.refill(8) == 2);
+    CHECK(stream.window() == "d)");
+    CHECK(stream.exhausted());
+    CHECK(stream.refill(2) == 0);
+    CHECK(stream.window().empty());
+    ::close(fd);
+}
+
+TEST_CASE("SourceStream locates offsets across refills") {
+    int fd = pipe_source("int\nmain\n  (void)");
+    SourceStream stream(fd, 6);
+    CHECK(stream.locate(1) == Location{1, 2});
+    CHECK(stream.locate(5) == Location{2, 2});
+
+    stream.refill(5);
+    stream.refill(4);
+    CHECK(stream.window() == "  (voi");
+    CHECK(stream.locate(11) == Location{3, 3});
+    // Discarded offsets resolve to the window start
+    CHECK(stream.locate(0) == Location{3, 1});
+    ::close(fd);
+}
+
+TEST_CASE("streaming lexer handles tokens split across refills") {
+    std::string source{};
+    for (int i = 0; i < 40; i++) {
+        source += "int main(void) {\n  return ~(--identifier_x42 -- "
+                  "9223372036854775807 -2147483648 @); }\n";
+    }
+    auto expected = tokenize(source);
+
+    for (std::size_t capacity : {20, 21, 23, 32, 4096}) {
+        CAPTURE(capacity);
+        int fd = pipe_source(source);
+        SourceStream stream(fd, capacity);
+        Lexer lexer(stream);
+        std::size_t i{0};
+        std::size_t mismatches{0};
+        for (auto token = lexer.next(); !token.is(TokenKind::Eof);
+             token = lexer.next(), i++) {
+            REQUIRE(i < expected.size());
+            bool same = token.kind == expected.kind(i) &&
+                        token.offset == expected[i].offset &&
+                        lexer.to_str(token) == expected.to_str(i);
+            if (same && token.is(TokenKind::Integer)) {
+                same = lexer.value(token) == expected.value(i);
+            }
+            mismatches += !same;
+        }
+        CHECK(i == expected.size());
+        CHECK(mismatches == 0);
+        ::close(fd);
+    }
+}
+
+TEST_CASE("streaming lexer rejects tokens larger than its buffer") {
+    int fd = pipe_source("return a_very_long_identifier;");
+    SourceStream stream(fd, 8);
+    Lexer lexer(stream);
+    CHECK(lexer.next().is(TokenKind::Return));
+    REQUIRE_THROWS_WITH_AS(lexer.next(),
+                           "Token does not fit in the 8 byte stream buffer",
+                           SyntaxError);
+    ::close(fd);
+}
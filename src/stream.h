@@ -0,0 +1,45 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string_view>
+
+#include "location.h"
+
+// Fixed-capacity window over an input file descriptor, for lexing stdin and
+// pipes without holding the whole input. Only the bytes in window() are
+// addressable; refill() drops consumed bytes from the front and reads more
+// behind the rest, so memory stays at `capacity` however long the input is.
+class SourceStream {
+    int _fd{-1};
+    std::unique_ptr<char[]> _buffer{};
+    std::size_t _capacity{};
+    std::size_t _size{0};
+    std::uint64_t _base{0}; // stream offset of the window's first byte
+    Location _base_location{1, 1};
+    bool _exhausted{false};
+
+  public:
+    static constexpr std::size_t DEFAULT_CAPACITY = 64 * 1024;
+
+    // Does not take ownership of `fd`
+    explicit SourceStream(int fd, std::size_t capacity = DEFAULT_CAPACITY);
+
+    [[nodiscard]] std::string_view window() const noexcept {
+        return {_buffer.get(), _size};
+    }
+    [[nodiscard]] std::uint64_t base() const noexcept { return _base; }
+    [[nodiscard]] std::size_t capacity() const noexcept { return _capacity; }
+
+    // True once the input has ended; window() then holds the rest of it
+    [[nodiscard]] bool exhausted() const noexcept { return _exhausted; }
+
+    // Discards the first `consumed` bytes of the window and reads until it is
+    // full or the input ends. Returns the number of bytes read.
+    std::size_t refill(std::size_t consumed);
+
+    // Location of a stream offset. Offsets that were already discarded
+    // resolve to the start of the window.
+    [[nodiscard]] Location locate(std::uint64_t offset) const;
+};
@@ -0,0 +1,74 @@
+#include <mutex>
+#include <stdexcept>
+
+#include "doctest.h"
+#include "symbol.h"
+
+std::string_view Symbol::to_str() const { return symbols().name(*this); }
+
+SymbolTable::SymbolTable() {
+    // The default Symbol names the empty string
+    intern("");
+}
+
+Symbol SymbolTable::intern(std::string_view text) {
+    {
+        std::shared_lock lock(_mutex);
+        auto it = _ids.find(text);
+        if (it != _ids.end()) {
+            return Symbol(it->second);
+        }
+    }
+
+    std::unique_lock lock(_mutex);
+    auto it = _ids.find(text);
+    if (it != _ids.end()) {
+        return Symbol(it->second);
+    }
+    if (_names.size() > UINT32_MAX) {
+        throw std::length_error("Too many distinct identifiers");
+    }
+    auto id = static_cast<std::uint32_t>(_names.size());
+    const auto &stored = _names.emplace_back(text);
+    _ids.emplace(stored, id);
+    return Symbol(id);
+}
+
+std::string_view SymbolTable::name(Symbol symbol) const {
+    std::shared_lock lock(_mutex);
+    return _names.at(symbol.id());
+}
+
+std::size_t SymbolTable::size() const {
+    std::shared_lock lock(_mutex);
+    return _names.size();
+}
+
+SymbolTable &symbols() {
+    static SymbolTable table;
+    return table;
+}
+
+//// TESTS ////
+
+TEST_CASE("SymbolTable hands out one id per distinct text") {
+    SymbolTable table;
+    auto main = table.intern("main");
+    auto other = table.intern("other");
+    CHECK(main == table.intern(std::string("main")));
+    CHECK(main != other);
+    CHECK(table.name(main) == "main");
+    CHECK(table.name(other) == "other");
+    CHECK(table.intern("") == Symbol());
+    CHECK(table.size() == 3);
+}
+
+TEST_CASE("interned text stays valid as the table grows") {
+    SymbolTable table;
+    auto first = table.name(table.intern("first"));
+    for (int i = 0; i < 1000; i++) {
+        table.intern("sym" + std::to_string(i));
+    }
+    CHECK(first == "first");
+    CHECK(table.name(table.intern("sym999")) == "sym999");
+}
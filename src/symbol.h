@@ -0,0 +1,50 @@
+#pragma once
+
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <shared_mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+
+// Interned identifier. Two symbols are equal exactly when their text is, so
+// every stage compares and hashes them as integers; the text is only needed
+// when emitting or dumping.
+class Symbol {
+    std::uint32_t _id{};
+
+  public:
+    constexpr Symbol() = default;
+    constexpr explicit Symbol(std::uint32_t id) : _id(id) {}
+
+    [[nodiscard]] constexpr std::uint32_t id() const noexcept { return _id; }
+    [[nodiscard]] std::string_view to_str() const;
+
+    friend constexpr bool operator==(Symbol, Symbol) = default;
+};
+
+template <> struct std::hash<Symbol> {
+    std::size_t operator()(Symbol s) const noexcept { return s.id(); }
+};
+
+// Thread-safe; interned text lives as long as the table.
+class SymbolTable {
+    mutable std::shared_mutex _mutex{};
+    std::deque<std::string> _names{};
+    std::unordered_map<std::string_view, std::uint32_t> _ids{};
+
+  public:
+    SymbolTable();
+    SymbolTable(const SymbolTable &) = delete;
+    SymbolTable &operator=(const SymbolTable &) = delete;
+
+    Symbol intern(std::string_view);
+    std::string_view name(Symbol) const;
+    std::size_t size() const;
+};
+
+// The process-wide table shared by every stage
+SymbolTable &symbols();
+
+inline Symbol intern(std::string_view text) { return symbols().intern(text); }
@@ -1,5 +1,8 @@
 #include <algorithm>
-#include <memory>
+#include <ranges>
+#include <sstream>
+#include <stdexcept>
+#include <utility>
 #include <vector>
 
 #include "doctest.h"
@@ -7,164 +10,372 @@
 #include "tacky.h"
 
 namespace Tacky {
-Program Generator::convert_ast(Ast::Program &ast) {
-    return convert_function(ast.fn());
+void print(std::ostream &out, const Function &fn, Val val) {
+    if (is_constant(val)) {
+        out << "Constant(" << constant(fn, val) << ')';
+    } else {
+        out << "Var(" << fn.name.to_str() << '.' << index(val) << ')';
+    }
 }
 
-std::unique_ptr<Function>
-Generator::convert_function(std::unique_ptr<Ast::Function> &fn) {
-    convert_statement(fn->body());
-    return std::make_unique<Function>(fn->name(), std::move(_instrs));
+void print(std::ostream &out, const Function &fn, const Instruction &instr) {
+    switch (instr.kind()) {
+    case Instruction::Kind::Return:
+        out << "Return(";
+        print(out, fn, instr.return_().val);
+        break;
+    case Instruction::Kind::Unary:
+        out << "Unary(";
+        print(out, instr.unary().op);
+        out << ", ";
+        print(out, fn, instr.unary().src);
+        out << ", ";
+        print(out, fn, instr.unary().dst);
+        break;
+    }
+    out.put(')');
 }
 
-void Generator::convert_statement(std::unique_ptr<Ast::Statement> stmt) {
-    auto return_stmt = dynamic_cast<Ast::Return *>(stmt.release());
-    auto val = convert_exp(return_stmt->exp());
-    _instrs.emplace_back(std::make_unique<Return>(std::move(val)));
+std::string to_string(const Function &fn, Val val) {
+    std::ostringstream out{};
+    print(out, fn, val);
+    return out.str();
 }
 
-std::unique_ptr<Val> Generator::convert_exp(std::unique_ptr<Ast::Exp> exp) {
-    if (auto *constant = dynamic_cast<Ast::Constant *>(exp.get())) {
-        return std::make_unique<Constant>(constant->value());
-    } else {
-        auto unary(dynamic_cast<Ast::Unary *>(exp.get()));
-        auto tacky_op = convert_unop(unary->op());
-        auto src = convert_exp(unary->exp());
-        auto name = temp_name();
-        auto instr = std::make_unique<Unary>(
-            std::move(tacky_op), std::move(src), std::make_unique<Var>(name));
-        _instrs.emplace_back(std::move(instr));
-        return std::make_unique<Var>(name);
+std::string to_string(const Function &fn, const Instruction &instr) {
+    std::ostringstream out{};
+    print(out, fn, instr);
+    return out.str();
+}
+
+void pretty_print(std::ostream &out, const Function &fn, int indent) {
+    auto pad = [&](int width) {
+        for (int i = 0; i < width; i++) {
+            out.put(' ');
+        }
+    };
+    out << "Function(\n";
+    pad(indent + 2);
+    out << "name=\"" << fn.name.to_str() << "\",\n";
+    pad(indent + 2);
+    out << "body=";
+    for (std::size_t i = 0; i < fn.body.size(); i++) {
+        if (i > 0) {
+            out << ", ";
+        }
+        print(out, fn, fn.body[i]);
+    }
+    out.put('\n');
+    pad(indent);
+    out.put(')');
+}
+
+void pretty_print(std::ostream &out, const Program &program) {
+    out << "Program(";
+    for (std::size_t i = 0; i < program.functions.size(); i++) {
+        out << (i ? ",\n  " : "\n  ");
+        pretty_print(out, program.functions[i], 2);
     }
+    out << "\n)";
+}
+
+Program Generator::convert_ast(const Ast::Program &ast) {
+    std::pmr::vector<Function> functions(&_arena);
+    functions.reserve(ast.functions.size());
+    for (const auto &fn : ast.functions) {
+        functions.push_back(convert_function(fn));
+    }
+    return Program{_arena.adopt(functions)};
+}
+
+Function Generator::convert_function(const Ast::Function &fn) {
+    _registers = 0;
+    _values.clear();
+    convert_statement(fn.body);
+    return Function{fn.name, _arena.adopt(_instrs), _arena.adopt(_constants),
+                    std::exchange(_registers, 0)};
 }
 
-std::unique_ptr<UnaryOperator>
-Generator::convert_unop(std::unique_ptr<Ast::UnaryOperator> op) {
-    if (auto *comp = dynamic_cast<Ast::Complement *>(op.get())) {
-        return std::make_unique<Complement>();
+void Generator::convert_statement(const Ast::Return &stmt) {
+    _instrs.emplace_back(Instruction::Return{convert_exp(stmt.exp)});
+}
+
+// Walks down a unary chain until an operand that was already lowered, then
+// emits the instructions from there outwards
+Val Generator::convert_exp(const Ast::Exp *exp) {
+    std::vector<const Ast::Exp *> chain{};
+    auto known = _values.find(exp);
+    while (known == _values.end() && exp->is(Ast::Exp::Kind::Unary)) {
+        chain.push_back(exp);
+        exp = exp->unary().exp;
+        known = _values.find(exp);
+    }
+
+    Val val{};
+    if (known != _values.end()) {
+        val = known->second;
     } else {
-        return std::make_unique<Negate>();
+        val = new_constant(exp->constant().value);
+        _values.emplace(exp, val);
+    }
+    for (auto *node : chain | std::views::reverse) {
+        auto dst = new_register();
+        _instrs.emplace_back(
+            Instruction::Unary{convert_unop(node->unary().op), val, dst});
+        _values.emplace(node, dst);
+        val = dst;
+    }
+    return val;
+}
+
+Val Generator::new_register() {
+    if (_registers == CONSTANT_BIT) {
+        throw std::length_error("Too many temporaries in one function");
+    }
+    return reg(_registers++);
+}
+
+Val Generator::new_constant(std::int64_t value) {
+    if (_constants.size() == CONSTANT_BIT) {
+        throw std::length_error("Too many constants in one function");
+    }
+    _constants.push_back(value);
+    return pooled(static_cast<std::uint32_t>(_constants.size() - 1));
+}
+
+UnaryOperator Generator::convert_unop(Ast::UnaryOperator op) {
+    switch (op) {
+    case Ast::UnaryOperator::Complement:
+        return UnaryOperator::Complement;
+    case Ast::UnaryOperator::Negate:
+        return UnaryOperator::Negate;
     }
+    __builtin_unreachable();
 }
 } // namespace Tacky
 
 //// TESTS ////
 
+namespace {
+// Instruction `i` of the function `gen` is converting, named "tmp"
+std::string pending(const Tacky::Generator &gen, std::size_t i) {
+    auto fn = gen.pending(intern("tmp"));
+    return to_string(fn, fn.body[i]);
+}
+
+std::string operand(const Tacky::Generator &gen, Tacky::Val val) {
+    return to_string(gen.pending(intern("tmp")), val);
+}
+
+// Return(Unary(Complement, Constant(123)))
+struct ComplementFixture {
+    Ast::Exp constant = Ast::Exp::Constant{123};
+    Ast::Exp unary =
+        Ast::Exp::Unary{Ast::UnaryOperator::Complement, &constant};
+    Ast::Return stmt{&unary};
+    Ast::Function fn{intern("main"), stmt};
+};
+} // namespace
+
 TEST_CASE("convert_ast") {
-    auto unary =
-        std::make_unique<Ast::Unary>(std::make_unique<Ast::Complement>(),
-                                     std::make_unique<Ast::Constant>("123"));
-    auto stmt = std::make_unique<Ast::Return>(std::move(unary));
-    auto fn = std::make_unique<Ast::Function>("main", std::move(stmt));
-    auto program = Ast::Program(std::move(fn));
-    Tacky::Generator gen;
-    auto tacky_ir = gen.convert_ast(program);
-
-    auto instrs = tacky_ir.fn()->body();
+    ComplementFixture ast{};
+    Arena arena{};
+    Tacky::Generator gen(arena);
+    auto tacky_ir = gen.convert_ast(Ast::Program{{&ast.fn, 1}});
+
+    REQUIRE(tacky_ir.functions.size() == 1);
+    auto instrs = tacky_ir.functions[0].body;
     CHECK(instrs.size() == 2);
-    CHECK(dynamic_cast<Tacky::Unary *>(instrs[0].release()));
-    CHECK(dynamic_cast<Tacky::Return *>(instrs[1].release()));
+    CHECK(instrs[0].is(Tacky::Instruction::Kind::Unary));
+    CHECK(instrs[1].is(Tacky::Instruction::Kind::Return));
+    CHECK(gen.instructions().empty());
+}
+
+TEST_CASE("convert_ast names temporaries after their function") {
+    Arena arena{};
+    Ast::Parser parser("int main(void) { return -1; }\n"
+                       "int helper(void) { return ~-2; }",
+                       arena);
+    auto ast = parser.parse();
+    Tacky::Generator gen(arena);
+    auto tacky_ir = gen.convert_ast(ast);
+
+    REQUIRE(tacky_ir.functions.size() == 2);
+    CHECK(to_string(tacky_ir.functions[0], tacky_ir.functions[0].body[0]) ==
+          "Unary(Negate, Constant(1), Var(main.0))");
+    CHECK(to_string(tacky_ir.functions[1], tacky_ir.functions[1].body[1]) ==
+          "Unary(Complement, Var(helper.0), Var(helper.1))");
 }
 
 TEST_CASE("convert_function with one statement") {
-    auto unary =
-        std::make_unique<Ast::Unary>(std::make_unique<Ast::Complement>(),
-                                     std::make_unique<Ast::Constant>("123"));
-    auto stmt = std::make_unique<Ast::Return>(std::move(unary));
-    auto fn = std::make_unique<Ast::Function>("main", std::move(stmt));
-    Tacky::Generator gen;
-    auto tacky_fn = gen.convert_function(fn);
-
-    auto instrs = tacky_fn->body();
+    ComplementFixture ast{};
+    Arena arena{};
+    Tacky::Generator gen(arena);
+    auto tacky_fn = gen.convert_function(ast.fn);
+
+    auto instrs = tacky_fn.body;
     CHECK(instrs.size() == 2);
-    CHECK(instrs[0]->to_string() ==
+    CHECK(to_string(tacky_fn, instrs[0]) ==
           "Unary(Complement, Constant(123), Var(main.0))");
-    CHECK(instrs[1]->to_string() == "Return(Var(main.0))");
+    CHECK(to_string(tacky_fn, instrs[1]) == "Return(Var(main.0))");
+    std::ostringstream pretty{};
+    Tacky::pretty_print(pretty, tacky_fn);
+    CHECK(pretty.str() ==
+          "Function(\n  name=\"main\",\n  body=Unary(Complement, "
+          "Constant(123), Var(main.0)), Return(Var(main.0))\n)");
 }
 
 TEST_CASE("convert_statement for returning a nested unary complement") {
     // Return(Unary(Negate,
     //              Unary(Complement,
     //                    Unary(Negate, Constant(97)))))
-    auto unary1 = std::make_unique<Ast::Unary>(
-        std::make_unique<Ast::Negate>(), std::make_unique<Ast::Constant>("97"));
-    auto unary2 = std::make_unique<Ast::Unary>(
-        std::make_unique<Ast::Complement>(), std::move(unary1));
-    auto unary3 = std::make_unique<Ast::Unary>(std::make_unique<Ast::Negate>(),
-                                               std::move(unary2));
-    auto stmt = std::make_unique<Ast::Return>(std::move(unary3));
-    Tacky::Generator gen;
-    gen.convert_statement(std::move(stmt));
+    using Ast::Exp;
+    Exp constant = Exp::Constant{97};
+    Exp unary1 = Exp::Unary{Ast::UnaryOperator::Negate, &constant};
+    Exp unary2 = Exp::Unary{Ast::UnaryOperator::Complement, &unary1};
+    Exp unary3 = Exp::Unary{Ast::UnaryOperator::Negate, &unary2};
+    Arena arena{};
+    Tacky::Generator gen(arena);
+    gen.convert_statement(Ast::Return{&unary3});
 
     CHECK(gen.instructions().size() == 4);
-    CHECK(gen.instructions()[0]->to_string() ==
-          "Unary(Negate, Constant(97), Var(main.0))");
-    CHECK(gen.instructions()[1]->to_string() ==
-          "Unary(Complement, Var(main.0), Var(main.1))");
-    CHECK(gen.instructions()[2]->to_string() ==
-          "Unary(Negate, Var(main.1), Var(main.2))");
-    CHECK(gen.instructions()[3]->to_string() == "Return(Var(main.2))");
+    CHECK(pending(gen, 0) ==
+          "Unary(Negate, Constant(97), Var(tmp.0))");
+    CHECK(pending(gen, 1) ==
+          "Unary(Complement, Var(tmp.0), Var(tmp.1))");
+    CHECK(pending(gen, 2) ==
+          "Unary(Negate, Var(tmp.1), Var(tmp.2))");
+    CHECK(pending(gen, 3) == "Return(Var(tmp.2))");
 }
 
 TEST_CASE("convert_statement for returning a single unary complement") {
-    // Return(Unary(Complement, Constant(123)))
-    auto unary =
-        std::make_unique<Ast::Unary>(std::make_unique<Ast::Complement>(),
-                                     std::make_unique<Ast::Constant>("123"));
-    auto stmt = std::make_unique<Ast::Return>(std::move(unary));
-    Tacky::Generator gen;
-    gen.convert_statement(std::move(stmt));
+    ComplementFixture ast{};
+    Arena arena{};
+    Tacky::Generator gen(arena);
+    gen.convert_statement(ast.stmt);
 
     CHECK(gen.instructions().size() == 2);
-    CHECK(gen.instructions()[0]->to_string() ==
-          "Unary(Complement, Constant(123), Var(main.0))");
-    CHECK(gen.instructions()[1]->to_string() == "Return(Var(main.0))");
+    CHECK(pending(gen, 0) ==
+          "Unary(Complement, Constant(123), Var(tmp.0))");
+    CHECK(pending(gen, 1) == "Return(Var(tmp.0))");
 }
 
 TEST_CASE("convert_statement for returning a constant") {
     // Return(Constant(88))
-    auto exp = std::make_unique<Ast::Constant>("88");
-    auto stmt = std::make_unique<Ast::Return>(std::move(exp));
-    Tacky::Generator gen;
-    gen.convert_statement(std::move(stmt));
+    Ast::Exp exp = Ast::Exp::Constant{88};
+    Arena arena{};
+    Tacky::Generator gen(arena);
+    gen.convert_statement(Ast::Return{&exp});
     CHECK(gen.instructions().size() == 1);
-    CHECK(gen.instructions()[0]->to_string() == "Return(Constant(88))");
+    CHECK(pending(gen, 0) == "Return(Constant(88))");
 }
 
 TEST_CASE("convert_exp for a unary negate exp") {
-    auto op = std::make_unique<Ast::Negate>();
-    auto exp = std::make_unique<Ast::Constant>("420");
-    auto unary = std::make_unique<Ast::Unary>(std::move(op), std::move(exp));
-    Tacky::Generator gen;
-    auto dst = gen.convert_exp(std::move(unary));
+    Ast::Exp exp = Ast::Exp::Constant{420};
+    Ast::Exp unary = Ast::Exp::Unary{Ast::UnaryOperator::Negate, &exp};
+    Arena arena{};
+    Tacky::Generator gen(arena);
+    auto dst = gen.convert_exp(&unary);
 
-    CHECK(dst->value() == "main.0");
+    CHECK(operand(gen, dst) == "Var(tmp.0)");
     CHECK(gen.instructions().size() == 1);
-    auto tacky_unary =
-        dynamic_cast<Tacky::Unary *>(gen.instructions()[0].release());
-    CHECK(tacky_unary);
-    CHECK(dynamic_cast<Tacky::Negate *>(tacky_unary->op().release()));
+    REQUIRE(gen.instructions()[0].is(Tacky::Instruction::Kind::Unary));
+    CHECK(gen.instructions()[0].unary().op == Tacky::UnaryOperator::Negate);
 }
 
 TEST_CASE("convert_exp for a unary complement exp") {
-    auto op = std::make_unique<Ast::Complement>();
-    auto exp = std::make_unique<Ast::Constant>("420");
-    auto unary = std::make_unique<Ast::Unary>(std::move(op), std::move(exp));
-    Tacky::Generator gen;
+    Ast::Exp exp = Ast::Exp::Constant{420};
+    Ast::Exp unary = Ast::Exp::Unary{Ast::UnaryOperator::Complement, &exp};
+    Arena arena{};
+    Tacky::Generator gen(arena);
 
-    auto dst = gen.convert_exp(std::move(unary));
-    CHECK(dst->value() == "main.0");
+    auto dst = gen.convert_exp(&unary);
+    CHECK(operand(gen, dst) == "Var(tmp.0)");
     CHECK(gen.instructions().size() == 1);
-    auto tacky_unary =
-        dynamic_cast<Tacky::Unary *>(gen.instructions()[0].release());
-    CHECK(tacky_unary);
-    CHECK(dynamic_cast<Tacky::Complement *>(tacky_unary->op().release()));
+    REQUIRE(gen.instructions()[0].is(Tacky::Instruction::Kind::Unary));
+    CHECK(gen.instructions()[0].unary().op ==
+          Tacky::UnaryOperator::Complement);
 }
 
 TEST_CASE("convert_exp for a constant") {
-    Tacky::Generator gen;
-    auto exp = std::make_unique<Ast::Constant>("42");
-    auto dst = gen.convert_exp(std::move(exp));
-    CHECK(dst->value() == "42");
+    Arena arena{};
+    Tacky::Generator gen(arena);
+    Ast::Exp exp = Ast::Exp::Constant{42};
+    auto dst = gen.convert_exp(&exp);
+    CHECK(operand(gen, dst) == "Constant(42)");
     CHECK(gen.instructions().size() == 0);
 }
+
+TEST_CASE("the function body keeps the generator's arena storage") {
+    ComplementFixture ast{};
+    Arena arena{};
+    Tacky::Generator gen(arena);
+    auto used = arena.stats().used;
+    auto tacky_fn = gen.convert_function(ast.fn);
+
+    // Adopting the instruction vector must not copy it
+    CHECK(arena.stats().used - used <=
+          2 * tacky_fn.body.size_bytes() + 64);
+    CHECK(gen.instructions().empty());
+    CHECK(to_string(tacky_fn, tacky_fn.body[1]) == "Return(Var(main.0))");
+}
+
+TEST_CASE("convert_exp lowers deep unary chains without recursion") {
+    constexpr int depth = 250'000;
+    Arena arena{};
+    const Ast::Exp *exp = arena.make<Ast::Exp>(Ast::Exp::Constant{5});
+    for (int i = 0; i < depth; i++) {
+        exp = arena.make<Ast::Exp>(
+            Ast::Exp::Unary{Ast::UnaryOperator::Negate, exp});
+    }
+    Tacky::Generator gen(arena);
+    auto dst = gen.convert_exp(exp);
+
+    REQUIRE(gen.instructions().size() == depth);
+    CHECK(pending(gen, 0) ==
+          "Unary(Negate, Constant(5), Var(tmp.0))");
+    CHECK(operand(gen, dst) == std::format("Var(tmp.{})", depth - 1));
+}
+
+TEST_CASE("convert_exp reuses the value of a shared subtree") {
+    Ast::Exp constant = Ast::Exp::Constant{3};
+    Ast::Exp shared = Ast::Exp::Unary{Ast::UnaryOperator::Negate, &constant};
+    Ast::Exp outer = Ast::Exp::Unary{Ast::UnaryOperator::Complement, &shared};
+    Arena arena{};
+    Tacky::Generator gen(arena);
+
+    CHECK(operand(gen, gen.convert_exp(&shared)) == "Var(tmp.0)");
+    CHECK(operand(gen, gen.convert_exp(&outer)) == "Var(tmp.1)");
+    CHECK(operand(gen, gen.convert_exp(&outer)) == "Var(tmp.1)");
+    REQUIRE(gen.instructions().size() == 2);
+    CHECK(pending(gen, 1) ==
+          "Unary(Complement, Var(tmp.0), Var(tmp.1))");
+
+    // Values do not carry over into the next function
+    gen.convert_function({intern("first"), Ast::Return{&outer}});
+    auto tacky_fn = gen.convert_function({intern("next"), Ast::Return{&outer}});
+    CHECK(tacky_fn.body.size() == 3);
+    CHECK(to_string(tacky_fn, tacky_fn.body[2]) == "Return(Var(next.1))");
+}
+
+TEST_CASE("instructions are an opcode byte and 32-bit operand slots") {
+    static_assert(sizeof(Tacky::Val) == 4);
+    static_assert(sizeof(Tacky::Instruction) == 16);
+    static_assert(std::is_trivially_copyable_v<Tacky::Instruction>);
+
+    Arena arena{};
+    Ast::Parser parser("int main(void) { return -(~(-5)); }", arena);
+    auto ast = parser.parse();
+    Tacky::Generator gen(arena);
+    auto fn = gen.convert_function(ast.functions[0]);
+
+    CHECK(fn.registers == 3);
+    REQUIRE(fn.constants.size() == 1);
+    CHECK(fn.constants[0] == 5);
+    const auto &first = fn.body[0].unary();
+    CHECK(Tacky::is_constant(first.src));
+    CHECK(Tacky::index(first.src) == 0);
+    CHECK(!Tacky::is_constant(first.dst));
+    CHECK(Tacky::index(first.dst) == 0);
+    CHECK(first.src.bits == Tacky::CONSTANT_BIT);
+}
@@ -1,157 +1,81 @@
 #pragma once
 
-#include <algorithm>
-#include <format>
-#include <memory>
-#include <numeric>
+#include <cassert>
+#include <cstdint>
+#include <memory_resource>
+#include <ostream>
+#include <string>
+#include <unordered_map>
 #include <vector>
 
+#include "arena.h"
 #include "parser.h"
+#include "tacky_nodes.h"
 
 namespace Tacky {
-class Val {
-  public:
-    virtual ~Val() = default;
-    virtual std::string const value() = 0;
-    virtual std::string const to_string() = 0;
-};
-
-class Constant : public Val {
-    std::string _int{};
-
-  public:
-    Constant(std::string i) : _int(i) {}
-    std::string const value() override { return _int; }
-    std::string const to_string() override {
-        return std::format("Constant({})", _int);
-    }
-};
-
-class Var : public Val {
-    std::string _identifier{};
-
-  public:
-    Var(std::string i) : _identifier(i) {}
-    std::string const value() override { return _identifier; }
-    std::string const to_string() override {
-        return std::format("Var({})", _identifier);
-    }
-};
-
-class UnaryOperator {
-  public:
-    virtual ~UnaryOperator() = default;
-    virtual std::string const to_string() = 0;
-};
-
-class Complement : public UnaryOperator {
-  public:
-    std::string const to_string() override { return "Complement"; }
-};
-
-class Negate : public UnaryOperator {
-  public:
-    std::string const to_string() override { return "Negate"; }
-};
-
-class Instruction {
-  public:
-    virtual ~Instruction() = default;
-    virtual std::string const to_string() = 0;
-};
-
-class Return : public Instruction {
-    std::unique_ptr<Val> _val{};
-
-  public:
-    Return(std::unique_ptr<Val> v) : _val(std::move(v)) {}
-
-    std::unique_ptr<Val> &val() { return _val; }
-    std::string const to_string() override {
-        return std::format("Return({})", _val->to_string());
-    }
-};
-
-class Unary : public Instruction {
-    std::unique_ptr<UnaryOperator> _op{};
-    std::unique_ptr<Val> _src{};
-    std::unique_ptr<Val> _dst{};
-
-  public:
-    Unary(std::unique_ptr<UnaryOperator> op, std::unique_ptr<Val> src,
-          std::unique_ptr<Val> dst)
-        : _op(std::move(op)), _src(std::move(src)), _dst(std::move(dst)) {}
-
-    std::unique_ptr<UnaryOperator> op() { return std::move(_op); }
-    std::unique_ptr<Val> src() { return std::move(_src); }
-    std::unique_ptr<Val> dst() { return std::move(_dst); }
-
-    std::string const to_string() override {
-        return std::format("Unary({}, {}, {})", _op->to_string(),
-                           _src->to_string(), _dst->to_string());
-    }
-};
-
-class Function {
-    std::string _name{};
-    std::vector<std::unique_ptr<Instruction>> _body{};
-
-  public:
-    Function(std::string name, std::vector<std::unique_ptr<Instruction>> instrs)
-        : _name(name), _body(std::move(instrs)) {}
-    std::vector<std::unique_ptr<Instruction>> body() {
-        return std::move(_body);
-    }
-    std::string name() { return _name; }
-
-    std::string to_string(int indent = 0) {
-        int next_lvl = indent + 2;
-        std::vector<std::string> str_instrs{};
-        for (auto &instr : _body) {
-            str_instrs.push_back(instr->to_string());
-        }
-        auto body = std::accumulate(
-            str_instrs.begin() + 1, str_instrs.end(), str_instrs[0],
-            [](const std::string &prev, const std::string &next) {
-                return prev + ", " + next;
-            });
-        return std::format(
-            "Function(\n{:<{}}name=\"{}\",\n{:<{}}body={}\n{:<{}})", "",
-            next_lvl, _name, "", next_lvl, body, "", indent);
-    }
-};
-
-class Program {
-    std::unique_ptr<Function> _fn{};
-
-  public:
-    Program(std::unique_ptr<Function> fn) : _fn(std::move(fn)) {}
-    std::unique_ptr<Function> &fn() { return _fn; }
-    std::string to_string() {
-        return std::format("Program(\n  {}\n)", _fn->to_string(2));
-    }
-};
+// Operands are 32-bit: a virtual register number, or with CONSTANT_BIT set
+// an index into the function's constant pool
+constexpr std::uint32_t CONSTANT_BIT = 0x8000'0000;
+
+[[nodiscard]] constexpr Val reg(std::uint32_t number) {
+    assert(number < CONSTANT_BIT);
+    return Val{number};
+}
+[[nodiscard]] constexpr Val pooled(std::uint32_t index) {
+    assert(index < CONSTANT_BIT);
+    return Val{CONSTANT_BIT | index};
+}
+[[nodiscard]] constexpr bool is_constant(Val val) {
+    return val.bits & CONSTANT_BIT;
+}
+// Register number or constant pool index
+[[nodiscard]] constexpr std::uint32_t index(Val val) {
+    return val.bits & ~CONSTANT_BIT;
+}
+[[nodiscard]] inline std::int64_t constant(const Function &fn, Val val) {
+    assert(is_constant(val));
+    return fn.constants[index(val)];
+}
+
+// Operands of `fn` print as Constant(value) or Var(name.register), the
+// only place registers get names
+void print(std::ostream &, const Function &, Val);
+void print(std::ostream &, const Function &, const Instruction &);
+std::string to_string(const Function &, Val);
+std::string to_string(const Function &, const Instruction &);
+
+// Multi-line layout used by --tacky
+void pretty_print(std::ostream &, const Function &, int indent = 0);
+void pretty_print(std::ostream &, const Program &);
 
 class Generator {
-    int _temp_var_counter{};
-    std::vector<std::unique_ptr<Instruction>> _instrs{};
-
-    std::unique_ptr<UnaryOperator>
-    convert_unop(std::unique_ptr<Ast::UnaryOperator> op);
-
-    std::string temp_name() {
-        return std::format("main.{}", _temp_var_counter++);
-    }
+    Arena &_arena;
+    std::uint32_t _registers{};
+    std::pmr::vector<Instruction> _instrs;
+    std::pmr::vector<std::int64_t> _constants;
+    // Values already computed for shared expression nodes of the current
+    // function. Expressions are pure and registers are only assigned once,
+    // so a repeated subtree can reuse its earlier result.
+    std::unordered_map<const Ast::Exp *, Val> _values{};
+
+    UnaryOperator convert_unop(Ast::UnaryOperator op);
+    Val new_register();
+    Val new_constant(std::int64_t);
 
   public:
-    std::vector<std::unique_ptr<Instruction>> &instructions() {
-        return _instrs;
+    // Instruction lists and constant pools are built in `arena`
+    explicit Generator(Arena &arena)
+        : _arena(arena), _instrs(&arena), _constants(&arena) {}
+
+    std::pmr::vector<Instruction> &instructions() { return _instrs; }
+    // The function converted so far, viewing the generator's buffers
+    Function pending(Symbol name) const {
+        return Function{name, _instrs, _constants, _registers};
     }
 
-    Program convert_ast(Ast::Program &);
-    std::unique_ptr<Function>
-    convert_function(std::unique_ptr<Ast::Function> &);
-    void convert_statement(std::unique_ptr<Ast::Statement>);
-    std::unique_ptr<Val> convert_exp(std::unique_ptr<Ast::Exp>);
+    Program convert_ast(const Ast::Program &);
+    Function convert_function(const Ast::Function &);
+    void convert_statement(const Ast::Return &);
+    Val convert_exp(const Ast::Exp *);
 };
 } // namespace Tacky
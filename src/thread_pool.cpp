@@ -0,0 +1,195 @@
+#include <algorithm>
+#include <stdexcept>
+#include <utility>
+
+#include "doctest.h"
+#include "thread_pool.h"
+
+ThreadPool::ThreadPool(unsigned threads) {
+    threads = std::max(threads, 1u);
+    for (unsigned i = 0; i < threads; i++) {
+        _queues.push_back(std::make_unique<Queue>());
+    }
+    for (unsigned i = 1; i < threads; i++) {
+        _threads.emplace_back([this, i] { work(i); });
+    }
+}
+
+ThreadPool::~ThreadPool() {
+    {
+        std::lock_guard lock(_mutex);
+        _stopping = true;
+    }
+    _wake.notify_all();
+    for (auto &thread : _threads) {
+        thread.join();
+    }
+}
+
+// Owners take from the front of their queue and thieves from the back, so
+// tasks mostly run in index order and the two rarely contend
+bool ThreadPool::pop(unsigned worker, std::size_t &index) {
+    for (unsigned i = 0; i < size(); i++) {
+        auto &queue = *_queues[(worker + i) % size()];
+        std::lock_guard lock(queue.mutex);
+        if (queue.items.empty()) {
+            continue;
+        }
+        if (i == 0) {
+            index = queue.items.front();
+            queue.items.pop_front();
+        } else {
+            index = queue.items.back();
+            queue.items.pop_back();
+        }
+        return true;
+    }
+    return false;
+}
+
+void ThreadPool::drain(unsigned worker, const Body &body) {
+    std::size_t index{};
+    while (pop(worker, index)) {
+        // After a failure the rest of the batch is only counted off
+        if (!_failed) {
+            try {
+                body(index, worker);
+            } catch (...) {
+                std::lock_guard lock(_mutex);
+                if (!_error) {
+                    _error = std::current_exception();
+                }
+                _failed = true;
+            }
+        }
+        if (_remaining.fetch_sub(1) == 1) {
+            std::lock_guard lock(_mutex);
+            _done.notify_all();
+        }
+    }
+}
+
+void ThreadPool::work(unsigned worker) {
+    std::size_t seen{};
+    for (;;) {
+        const Body *body{};
+        {
+            std::unique_lock lock(_mutex);
+            _wake.wait(lock,
+                       [&] { return _stopping || _generation != seen; });
+            if (_stopping) {
+                return;
+            }
+            seen = _generation;
+            // woken too late: that batch is already over
+            if (!_body) {
+                continue;
+            }
+            body = _body;
+            _active++;
+        }
+        drain(worker, *body);
+        {
+            std::lock_guard lock(_mutex);
+            _active--;
+        }
+        _done.notify_all();
+    }
+}
+
+void ThreadPool::parallel_for(std::size_t count, const Body &body) {
+    if (count == 0) {
+        return;
+    }
+    if (count == 1 || size() == 1) {
+        for (std::size_t i = 0; i < count; i++) {
+            body(i, 0);
+        }
+        return;
+    }
+
+    // Each worker starts with a contiguous block of indices
+    for (std::size_t w = 0; w < size(); w++) {
+        auto &queue = *_queues[w];
+        std::lock_guard lock(queue.mutex);
+        for (auto i = count * w / size(); i < count * (w + 1) / size(); i++) {
+            queue.items.push_back(i);
+        }
+    }
+    _remaining = count;
+    _failed = false;
+    {
+        std::lock_guard lock(_mutex);
+        _body = &body;
+        _generation++;
+    }
+    _wake.notify_all();
+
+    drain(0, body);
+
+    // Workers still inside drain() may hold `body`, so wait for them too
+    std::unique_lock lock(_mutex);
+    _done.wait(lock, [&] { return _remaining == 0 && _active == 0; });
+    _body = nullptr;
+    if (_error) {
+        std::rethrow_exception(std::exchange(_error, nullptr));
+    }
+}
+
+//// TESTS ////
+
+TEST_CASE("parallel_for runs every index exactly once") {
+    for (unsigned threads : {1u, 2u, 4u}) {
+        ThreadPool pool(threads);
+        CHECK(pool.size() == threads);
+        for (std::size_t count : {0u, 1u, 3u, 100u}) {
+            std::vector<std::atomic<int>> runs(count);
+            std::vector<unsigned> workers(count);
+            pool.parallel_for(count, [&](std::size_t i, unsigned worker) {
+                runs[i]++;
+                workers[i] = worker;
+            });
+            for (std::size_t i = 0; i < count; i++) {
+                CHECK(runs[i] == 1);
+                CHECK(workers[i] < threads);
+            }
+        }
+    }
+}
+
+TEST_CASE("parallel_for steals from a busy worker") {
+    ThreadPool pool(2);
+    std::atomic<bool> release{};
+    std::atomic<int> finished{};
+    // Index 0 blocks worker 0's block until worker 1 has done all the rest,
+    // including the ones queued behind it
+    pool.parallel_for(8, [&](std::size_t i, unsigned) {
+        if (i == 0) {
+            while (!release) {
+                std::this_thread::yield();
+            }
+        } else if (++finished == 7) {
+            release = true;
+        }
+    });
+    CHECK(finished == 7);
+}
+
+TEST_CASE("parallel_for rethrows the first failure") {
+    ThreadPool pool(3);
+    std::atomic<int> ran{};
+    auto fail = [&](std::size_t i, unsigned) {
+        ran++;
+        if (i == 5) {
+            throw std::runtime_error("task 5 failed");
+        }
+    };
+    REQUIRE_THROWS_WITH_AS(pool.parallel_for(50, fail), "task 5 failed",
+                           std::runtime_error);
+    CHECK(ran >= 1);
+
+    // The pool is still usable afterwards
+    std::atomic<int> count{};
+    pool.parallel_for(10, [&](std::size_t, unsigned) { count++; });
+    CHECK(count == 10);
+}
@@ -0,0 +1,62 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Fixed set of workers that run batches of independent tasks. Each worker
+// owns a queue of task indices; once its own queue runs dry it steals from
+// the others, so a few expensive tasks do not leave the rest of the pool
+// idle. The calling thread takes part as worker 0.
+class ThreadPool {
+  public:
+    // Runs one task; `worker` is below size() and unique among the tasks
+    // running at the same time, so it can index per-worker state
+    using Body = std::function<void(std::size_t index, unsigned worker)>;
+
+  private:
+    struct Queue {
+        std::mutex mutex{};
+        std::deque<std::size_t> items{};
+    };
+
+    std::vector<std::unique_ptr<Queue>> _queues{};
+    std::vector<std::thread> _threads{};
+
+    std::mutex _mutex{};
+    std::condition_variable _wake{};
+    std::condition_variable _done{};
+    const Body *_body{};
+    std::size_t _generation{};
+    unsigned _active{};
+    bool _stopping{};
+    std::exception_ptr _error{};
+
+    std::atomic<std::size_t> _remaining{};
+    std::atomic<bool> _failed{};
+
+    bool pop(unsigned worker, std::size_t &index);
+    void drain(unsigned worker, const Body &body);
+    void work(unsigned worker);
+
+  public:
+    // `threads` counts the caller, so 1 runs everything inline
+    explicit ThreadPool(unsigned threads);
+    ~ThreadPool();
+    ThreadPool(const ThreadPool &) = delete;
+    ThreadPool &operator=(const ThreadPool &) = delete;
+
+    unsigned size() const { return static_cast<unsigned>(_queues.size()); }
+
+    // Calls `body` once for each index below `count` and returns when all
+    // calls have. The first exception thrown is rethrown here once the
+    // batch has drained. Not reentrant.
+    void parallel_for(std::size_t count, const Body &body);
+};
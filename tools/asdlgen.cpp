@@ -0,0 +1,684 @@
+// Turns an .asdl file into C++ node types:
+//
+//     asdlgen ast.asdl src/ast_nodes.h
+//
+// - a sum type whose constructors have no fields becomes an enum class
+// - a type with a single constructor becomes a plain struct
+// - any other sum type becomes a tagged union with a `Kind` to switch on,
+//   one nested struct per constructor, checked accessors and visit()
+//
+// Types that can contain themselves are "boxed": fields of those types are
+// pointers to nodes allocated in an Arena. Everything else is stored inline,
+// so every node is trivially copyable and never needs a destructor. Each
+// type also gets a print() in ASDL syntax; boxed types are printed with an
+// explicit stack so deep trees do not exhaust the call stack. The namespace
+// is the file name, capitalized (ast.asdl -> Ast).
+//
+// Builtin field types: `int` (std::int64_t), `uint` (std::uint32_t, for
+// compact indices) and `identifier` (Symbol).
+
+#include <algorithm>
+#include <cctype>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <map>
+#include <set>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace {
+struct Field {
+    std::string type{};
+    std::string name{};
+    bool list{};
+};
+
+struct Constructor {
+    std::string name{};
+    std::vector<Field> fields{};
+};
+
+struct Type {
+    std::string name{};
+    std::vector<Constructor> constructors{};
+
+    bool is_enum() const {
+        return constructors.size() > 1 &&
+               std::all_of(constructors.begin(), constructors.end(),
+                           [](const auto &c) { return c.fields.empty(); });
+    }
+    bool is_product() const { return constructors.size() == 1; }
+};
+
+std::string camel_case(const std::string &name) {
+    std::string out{};
+    bool upper = true;
+    for (char ch : name) {
+        if (ch == '_') {
+            upper = true;
+        } else {
+            out += upper ? static_cast<char>(std::toupper(ch)) : ch;
+            upper = false;
+        }
+    }
+    return out;
+}
+
+// Accessor name of a constructor, e.g. AllocateStack -> allocate_stack.
+// Keywords get a trailing underscore: Return -> return_.
+std::string snake_case(const std::string &name) {
+    static const std::set<std::string> keywords{
+        "bool", "break", "case",   "char",  "const", "continue", "default",
+        "do",   "else",  "float",  "for",   "goto",  "if",       "int",
+        "long", "new",   "return", "short", "switch", "void",    "while"};
+    std::string out{};
+    for (char ch : name) {
+        if (std::isupper(ch) && !out.empty()) {
+            out += '_';
+        }
+        out += static_cast<char>(std::tolower(ch));
+    }
+    return keywords.count(out) ? out + "_" : out;
+}
+
+class Reader {
+    std::string _text{};
+    std::size_t _pos{0};
+
+    void skip_space() {
+        while (_pos < _text.size()) {
+            if (std::isspace(_text[_pos])) {
+                _pos++;
+            } else if (_text.compare(_pos, 2, "--") == 0) {
+                _pos = _text.find('\n', _pos);
+            } else {
+                return;
+            }
+        }
+    }
+
+  public:
+    explicit Reader(std::string text) : _text(std::move(text)) {}
+
+    bool done() {
+        skip_space();
+        return _pos >= _text.size();
+    }
+
+    bool accept(char ch) {
+        skip_space();
+        if (_pos < _text.size() && _text[_pos] == ch) {
+            _pos++;
+            return true;
+        }
+        return false;
+    }
+
+    void expect(char ch) {
+        if (!accept(ch)) {
+            throw std::runtime_error(std::string("Expected '") + ch +
+                                     "' at byte " + std::to_string(_pos));
+        }
+    }
+
+    std::string word() {
+        skip_space();
+        auto start = _pos;
+        while (_pos < _text.size() &&
+               (std::isalnum(_text[_pos]) || _text[_pos] == '_')) {
+            _pos++;
+        }
+        if (start == _pos) {
+            throw std::runtime_error("Expected a name at byte " +
+                                     std::to_string(_pos));
+        }
+        return _text.substr(start, _pos - start);
+    }
+};
+
+std::vector<Type> read_asdl(const std::string &text) {
+    Reader in(text);
+    std::vector<Type> types{};
+    while (!in.done()) {
+        Type type{in.word()};
+        in.expect('=');
+        do {
+            Constructor constructor{in.word()};
+            if (in.accept('(')) {
+                do {
+                    Field field{in.word()};
+                    if (in.accept('?')) {
+                        throw std::runtime_error("Optional fields ('?') are "
+                                                 "not supported");
+                    }
+                    field.list = in.accept('*');
+                    field.name = in.word();
+                    constructor.fields.push_back(field);
+                } while (in.accept(','));
+                in.expect(')');
+            }
+            type.constructors.push_back(constructor);
+        } while (in.accept('|'));
+        types.push_back(type);
+    }
+    return types;
+}
+
+class Generator {
+    std::string _namespace{};
+    std::vector<Type> _types{};
+    std::map<std::string, const Type *> _by_name{};
+    std::set<std::string> _boxed{};
+    std::ostream &_out;
+
+    const Type *find(const std::string &name) const {
+        auto it = _by_name.find(name);
+        return it == _by_name.end() ? nullptr : it->second;
+    }
+
+    bool builtin(const std::string &type) const {
+        return type == "int" || type == "uint" || type == "identifier";
+    }
+
+    // C++ name of a type: products are named after their constructor
+    std::string cpp_name(const std::string &type) const {
+        if (type == "int") {
+            return "std::int64_t";
+        }
+        if (type == "uint") {
+            return "std::uint32_t";
+        }
+        if (type == "identifier") {
+            return "Symbol";
+        }
+        const auto *found = find(type);
+        if (!found) {
+            throw std::runtime_error("Undefined type " + type);
+        }
+        auto name = found->is_product() ? found->constructors[0].name
+                                        : camel_case(type);
+        return _namespace + "::" + name;
+    }
+
+    std::string short_name(const Type &type) const {
+        return type.is_product() ? type.constructors[0].name
+                                 : camel_case(type.name);
+    }
+
+    std::string element_type(const Field &field) const {
+        auto name = cpp_name(field.type);
+        return _boxed.count(field.type) ? "const " + name + " *" : name;
+    }
+
+    std::string field_type(const Field &field) const {
+        auto element = element_type(field);
+        if (!field.list) {
+            return element;
+        }
+        if (element.back() == '*') {
+            return "std::span<" + element + "const>";
+        }
+        return "std::span<const " + element + ">";
+    }
+
+    // Types reachable from `type` through any field
+    void reach(const std::string &type, std::set<std::string> &seen) const {
+        const auto *found = find(type);
+        if (!found) {
+            return;
+        }
+        for (const auto &constructor : found->constructors) {
+            for (const auto &field : constructor.fields) {
+                if (seen.insert(field.type).second) {
+                    reach(field.type, seen);
+                }
+            }
+        }
+    }
+
+    // Types whose layout needs `type` complete: inline fields, not pointers
+    // or lists
+    std::vector<std::string> inline_dependencies(const Type &type) const {
+        std::vector<std::string> dependencies{};
+        for (const auto &constructor : type.constructors) {
+            for (const auto &field : constructor.fields) {
+                if (!field.list && !builtin(field.type) &&
+                    !_boxed.count(field.type)) {
+                    dependencies.push_back(field.type);
+                }
+            }
+        }
+        return dependencies;
+    }
+
+    std::vector<const Type *> declaration_order() const {
+        std::vector<const Type *> order{};
+        std::set<std::string> done{};
+        std::function<void(const Type &)> visit = [&](const Type &type) {
+            if (!done.insert(type.name).second) {
+                return;
+            }
+            for (const auto &dependency : inline_dependencies(type)) {
+                visit(*find(dependency));
+            }
+            order.push_back(&type);
+        };
+        for (const auto &type : _types) {
+            visit(type);
+        }
+        return order;
+    }
+
+    void write_fields(const std::vector<Field> &fields,
+                      const std::string &indent) {
+        for (const auto &field : fields) {
+            auto type = field_type(field);
+            _out << indent << type << (type.back() == '*' ? "" : " ")
+                 << field.name << "{};\n";
+        }
+    }
+
+    void write_enum(const Type &type) {
+        _out << "enum class " << short_name(type) << " : std::uint8_t {\n";
+        for (const auto &constructor : type.constructors) {
+            _out << "    " << constructor.name << ",\n";
+        }
+        _out << "};\n\n";
+    }
+
+    void write_product(const Type &type) {
+        _out << "struct " << short_name(type) << " {\n";
+        write_fields(type.constructors[0].fields, "    ");
+        _out << "};\n\n";
+    }
+
+    void write_sum(const Type &type) {
+        auto name = short_name(type);
+        _out << "struct " << name << " {\n";
+        _out << "    enum class Kind : std::uint8_t {\n";
+        for (const auto &constructor : type.constructors) {
+            _out << "        " << constructor.name << ",\n";
+        }
+        _out << "    };\n\n";
+
+        for (const auto &constructor : type.constructors) {
+            _out << "    struct " << constructor.name << " {\n";
+            write_fields(constructor.fields, "        ");
+            _out << "    };\n";
+        }
+        _out << "\n";
+
+        _out << "    // Defaults to the first constructor\n    " << name
+             << "() : " << name << "(" << type.constructors[0].name
+             << "{}) {}\n";
+        for (const auto &constructor : type.constructors) {
+            auto member = snake_case(constructor.name);
+            _out << "    " << name << "(" << constructor.name << " "
+                 << member << ")\n        : _kind(Kind::" << constructor.name
+                 << "), _" << member << "(" << member << ") {}\n";
+        }
+        _out << "\n    [[nodiscard]] Kind kind() const noexcept { return "
+                "_kind; }\n";
+        _out << "    [[nodiscard]] bool is(Kind kind) const noexcept { "
+                "return _kind == kind; }\n\n";
+
+        for (const auto &constructor : type.constructors) {
+            auto member = snake_case(constructor.name);
+            for (auto qualifier : {"const ", ""}) {
+                _out << "    " << qualifier << constructor.name << " &"
+                     << member << "() " << qualifier << "{\n"
+                     << "        assert(_kind == Kind::" << constructor.name
+                     << ");\n"
+                     << "        return _" << member << ";\n    }\n";
+            }
+        }
+
+        _out << "\n    // Calls `visitor` with the active constructor";
+        for (auto qualifier : {"const ", ""}) {
+            _out << "\n    template <typename Visitor>\n"
+                    "    decltype(auto) visit(Visitor &&visitor) "
+                 << qualifier << "{\n        switch (_kind) {\n";
+            for (const auto &constructor : type.constructors) {
+                _out << "        case Kind::" << constructor.name
+                     << ":\n            return visitor(_"
+                     << snake_case(constructor.name) << ");\n";
+            }
+            _out << "        }\n        __builtin_unreachable();\n    }\n";
+        }
+
+        _out << "\n  private:\n    Kind _kind;\n    union {\n";
+        for (const auto &constructor : type.constructors) {
+            _out << "        " << constructor.name << " _"
+                 << snake_case(constructor.name) << ";\n";
+        }
+        _out << "    };\n};\n\n";
+    }
+
+    // Printing. Once a boxed node is reached, its remaining fields are
+    // pushed onto the pending stack of print_boxed() instead of being
+    // printed recursively. Pending items point into the tree, so nothing is
+    // formatted ahead of time.
+
+    std::vector<std::string> print_item_types() const {
+        std::vector<std::string> items{"const char *", "std::int64_t",
+                                       "Symbol"};
+        for (const auto &type : _types) {
+            items.push_back(type.is_enum() ? short_name(type)
+                                           : "const " + short_name(type) +
+                                                 " *");
+        }
+        return items;
+    }
+
+    // Statement printing `value` to `out`, `value` being of the field's
+    // element type
+    std::string print_value(const Field &field, const std::string &value) {
+        if (field.type == "int" || field.type == "uint") {
+            return "out << " + value + ";";
+        }
+        if (field.type == "identifier") {
+            return "out << " + value + ".to_str();";
+        }
+        if (_boxed.count(field.type)) {
+            return "print(out, *" + value + ");";
+        }
+        return "print(out, " + value + ");";
+    }
+
+    void write_print_fields(const std::vector<Field> &fields,
+                            const std::string &node, bool in_boxed,
+                            const std::string &indent) {
+        auto first_boxed = fields.size();
+        if (in_boxed) {
+            for (std::size_t i = 0; i < fields.size(); i++) {
+                if (_boxed.count(fields[i].type)) {
+                    first_boxed = i;
+                    break;
+                }
+            }
+        }
+
+        for (std::size_t i = 0; i < first_boxed; i++) {
+            const auto &field = fields[i];
+            auto value = node + "." + field.name;
+            if (i > 0) {
+                _out << indent << "out << \", \";\n";
+            }
+            if (field.list) {
+                _out << indent << "out << '[';\n"
+                     << indent << "for (std::size_t i = 0; i < " << value
+                     << ".size(); i++) {\n"
+                     << indent << "    out << (i ? \", \" : \"\");\n"
+                     << indent << "    " << print_value(field, value + "[i]")
+                     << "\n"
+                     << indent << "}\n"
+                     << indent << "out << ']';\n";
+            } else {
+                _out << indent << print_value(field, value) << "\n";
+            }
+        }
+        if (first_boxed == fields.size()) {
+            _out << indent << "out << ')';\n";
+            return;
+        }
+
+        // The rest is pushed in reverse so it pops in order
+        _out << indent << "pending.emplace_back(\")\");\n";
+        for (auto i = fields.size(); i-- > first_boxed;) {
+            const auto &field = fields[i];
+            auto value = node + "." + field.name;
+            auto push = [&](const std::string &element,
+                            const std::string &inner_indent) {
+                auto by_address = !builtin(field.type) &&
+                                  !find(field.type)->is_enum() &&
+                                  !_boxed.count(field.type);
+                _out << inner_indent << "pending.emplace_back("
+                     << (by_address ? "&" : "") << element << ");\n";
+            };
+            if (field.list) {
+                _out << indent << "pending.emplace_back(\"]\");\n"
+                     << indent << "for (auto j = " << value
+                     << ".size(); j-- > 0;) {\n";
+                push(value + "[j]", indent + "    ");
+                _out << indent << "    if (j > 0) {\n"
+                     << indent << "        pending.emplace_back(\", \");\n"
+                     << indent << "    }\n"
+                     << indent << "}\n"
+                     << indent << "pending.emplace_back(\"[\");\n";
+            } else {
+                push(value, indent);
+            }
+            if (i > 0) {
+                _out << indent << "pending.emplace_back(\", \");\n";
+            }
+        }
+    }
+
+    void write_printers() {
+        // Declarations first, since types print each other
+        for (const auto &type : _types) {
+            auto name = short_name(type);
+            _out << "void print(std::ostream &, "
+                 << (type.is_enum() ? name : "const " + name + " &")
+                 << ");\n";
+        }
+        _out << "\n// Text of any node, for tests and debugging\n"
+                "template <typename Node> std::string dump(const Node &node) "
+                "{\n    std::ostringstream out{};\n";
+        _out << "    if constexpr (std::is_same_v<Node, Symbol>) {\n"
+                "        out << node.to_str();\n"
+                "    } else if constexpr (std::is_arithmetic_v<Node>) {\n"
+                "        out << node;\n"
+                "    } else {\n"
+                "        print(out, node);\n"
+                "    }\n    return out.str();\n}\n\n";
+
+        if (!_boxed.empty()) {
+            _out << "namespace detail {\nusing PrintItem = std::variant<";
+            auto items = print_item_types();
+            for (std::size_t i = 0; i < items.size(); i++) {
+                _out << (i ? ", " : "") << items[i];
+            }
+            _out << ">;\n\n"
+                    "inline void print_boxed(std::ostream &out, PrintItem "
+                    "root) {\n"
+                    "    std::vector<PrintItem> pending{root};\n"
+                    "    while (!pending.empty()) {\n"
+                    "        auto item = pending.back();\n"
+                    "        pending.pop_back();\n"
+                    "        if (auto *text = "
+                    "std::get_if<const char *>(&item)) {\n"
+                    "            out << *text;\n"
+                    "        } else if (auto *value = "
+                    "std::get_if<std::int64_t>(&item)) {\n"
+                    "            out << *value;\n"
+                    "        } else if (auto *symbol = "
+                    "std::get_if<Symbol>(&item)) {\n"
+                    "            out << symbol->to_str();\n";
+            for (const auto &type : _types) {
+                auto name = short_name(type);
+                if (type.is_enum()) {
+                    _out << "        } else if (auto *value = std::get_if<"
+                         << name << ">(&item)) {\n"
+                         << "            print(out, *value);\n";
+                } else if (!_boxed.count(type.name)) {
+                    _out << "        } else if (auto *node = "
+                            "std::get_if<const "
+                         << name << " *>(&item)) {\n"
+                         << "            print(out, **node);\n";
+                } else {
+                    _out << "        } else if (auto *node = "
+                            "std::get_if<const "
+                         << name << " *>(&item)) {\n";
+                    write_boxed_body(type, "            ");
+                }
+            }
+            _out << "        }\n    }\n}\n} // namespace detail\n\n";
+        }
+
+        for (const auto &type : _types) {
+            auto name = short_name(type);
+            if (type.is_enum()) {
+                _out << "inline void print(std::ostream &out, " << name
+                     << " value) {\n    switch (value) {\n";
+                for (const auto &constructor : type.constructors) {
+                    _out << "    case " << name << "::" << constructor.name
+                         << ":\n        out << \"" << constructor.name
+                         << "\";\n        return;\n";
+                }
+                _out << "    }\n}\n\n";
+                continue;
+            }
+
+            _out << "inline void print(std::ostream &out, const " << name
+                 << " &node) {\n";
+            if (_boxed.count(type.name)) {
+                _out << "    detail::print_boxed(out, &node);\n}\n\n";
+                continue;
+            }
+            if (type.is_product()) {
+                write_constructor_print(type.constructors[0], "node", false,
+                                        "    ");
+            } else {
+                _out << "    switch (node.kind()) {\n";
+                for (const auto &constructor : type.constructors) {
+                    _out << "    case " << name
+                         << "::Kind::" << constructor.name << ": {\n";
+                    write_constructor_print(
+                        constructor,
+                        "node." + snake_case(constructor.name) + "()", false,
+                        "        ");
+                    _out << "        return;\n    }\n";
+                }
+                _out << "    }\n";
+            }
+            _out << "}\n\n";
+        }
+    }
+
+    void write_constructor_print(const Constructor &constructor,
+                                 const std::string &node, bool in_boxed,
+                                 const std::string &indent) {
+        if (constructor.fields.empty()) {
+            _out << indent << "out << \"" << constructor.name << "\";\n";
+            return;
+        }
+        _out << indent << "out << \"" << constructor.name << "(\";\n";
+        write_print_fields(constructor.fields, node, in_boxed, indent);
+    }
+
+    void write_boxed_body(const Type &type, const std::string &indent) {
+        auto name = short_name(type);
+        if (type.is_product()) {
+            _out << indent << "const auto &value = **node;\n";
+            write_constructor_print(type.constructors[0], "value", true,
+                                    indent);
+            return;
+        }
+        _out << indent << "switch ((*node)->kind()) {\n";
+        for (const auto &constructor : type.constructors) {
+            _out << indent << "case " << name << "::Kind::" << constructor.name
+                 << ": {\n";
+            _out << indent << "    const auto &value = (*node)->"
+                 << snake_case(constructor.name) << "();\n";
+            if (constructor.fields.empty()) {
+                _out << indent << "    (void)value;\n";
+            }
+            write_constructor_print(constructor, "value", true,
+                                    indent + "    ");
+            _out << indent << "    break;\n" << indent << "}\n";
+        }
+        _out << indent << "}\n";
+    }
+
+  public:
+    Generator(std::string ns, std::vector<Type> types, std::ostream &out)
+        : _namespace(std::move(ns)), _types(std::move(types)), _out(out) {
+        for (const auto &type : _types) {
+            _by_name[type.name] = &type;
+        }
+        for (const auto &type : _types) {
+            std::set<std::string> seen{};
+            reach(type.name, seen);
+            if (seen.count(type.name)) {
+                _boxed.insert(type.name);
+            }
+        }
+    }
+
+    void write(const std::string &source) {
+        _out << "// Generated from " << source
+             << " by tools/asdlgen.cpp. Do not edit.\n"
+                "#pragma once\n\n"
+                "#include <cassert>\n#include <cstdint>\n#include <ostream>\n"
+                "#include <span>\n#include <sstream>\n#include <string>\n"
+                "#include <type_traits>\n#include <variant>\n"
+                "#include <vector>\n\n"
+                "#include \"arena.h\"\n#include \"symbol.h\"\n\n"
+                "namespace "
+             << _namespace << " {\n";
+
+        for (const auto &type : _types) {
+            if (!type.is_enum()) {
+                _out << "struct " << short_name(type) << ";\n";
+            }
+        }
+        _out << "\n";
+
+        for (const auto *type : declaration_order()) {
+            if (type->is_enum()) {
+                write_enum(*type);
+            } else if (type->is_product()) {
+                write_product(*type);
+            } else {
+                write_sum(*type);
+            }
+        }
+
+        for (const auto &type : _types) {
+            if (!type.is_enum()) {
+                _out << "static_assert(std::is_trivially_copyable_v<"
+                     << short_name(type) << ">);\n";
+            }
+        }
+        _out << "\n";
+
+        write_printers();
+        _out << "} // namespace " << _namespace << "\n";
+    }
+};
+} // namespace
+
+int main(int argc, char *argv[]) {
+    if (argc != 3) {
+        std::cerr << "usage: asdlgen file.asdl output.h\n";
+        return 2;
+    }
+    std::string path = argv[1];
+    std::ifstream in(path);
+    if (!in) {
+        std::cerr << "asdlgen: cannot read " << path << "\n";
+        return 1;
+    }
+    std::stringstream text{};
+    text << in.rdbuf();
+
+    auto base = path.substr(path.find_last_of('/') + 1);
+    base = base.substr(0, base.find('.'));
+    auto ns = camel_case(base);
+
+    std::ostringstream header{};
+    try {
+        Generator(ns, read_asdl(text.str()), header).write(base + ".asdl");
+    } catch (const std::runtime_error &error) {
+        std::cerr << path << ": error: " << error.what() << "\n";
+        return 1;
+    }
+
+    std::ofstream out(argv[2]);
+    out << header.str();
+    return out ? 0 : 1;
+}
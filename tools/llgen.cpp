@@ -0,0 +1,430 @@
+// Reads grammar.ebnf and writes the LL(1) tables the parser is driven by:
+// FIRST and FOLLOW sets, the productions, and the parse table keyed by token
+// kind. Fails if the grammar is not LL(1).
+//
+//     llgen grammar.ebnf src/grammar_table.h
+//
+// Rules whose body is a special sequence (`? ... ?`) are token classes, e.g.
+// identifiers; they become terminals named by grammar.h's token_class(). An
+// alternative written as `""` is empty: it is chosen on the tokens that can
+// follow its rule.
+
+#include <algorithm>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace {
+struct GrammarSymbol {
+    bool terminal{};
+    std::string name{}; // nonterminal name, or C++ expression of a terminal
+};
+
+struct Production {
+    std::size_t lhs{};
+    std::vector<GrammarSymbol> rhs{};
+    std::string text{};
+};
+
+struct Grammar {
+    std::vector<std::string> nonterminals{};
+    std::vector<std::string> token_classes{};
+    std::vector<Production> productions{};
+
+    std::size_t index_of(const std::string &nonterminal) const {
+        auto it = std::find(nonterminals.begin(), nonterminals.end(),
+                            nonterminal);
+        if (it == nonterminals.end()) {
+            throw std::runtime_error("Undefined rule <" + nonterminal + ">");
+        }
+        return it - nonterminals.begin();
+    }
+};
+
+using TerminalSet = std::vector<std::string>;
+
+bool insert(TerminalSet &set, const std::string &terminal) {
+    if (std::find(set.begin(), set.end(), terminal) != set.end()) {
+        return false;
+    }
+    set.push_back(terminal);
+    return true;
+}
+
+std::string trim(const std::string &text) {
+    auto begin = text.find_first_not_of(" \t");
+    auto end = text.find_last_not_of(" \t");
+    return begin == std::string::npos ? ""
+                                      : text.substr(begin, end - begin + 1);
+}
+
+std::string camel_case(const std::string &name) {
+    std::string out{};
+    bool upper = true;
+    for (char ch : name) {
+        if (ch == '-' || ch == '_') {
+            upper = true;
+        } else {
+            out += upper ? static_cast<char>(std::toupper(ch)) : ch;
+            upper = false;
+        }
+    }
+    return out;
+}
+
+// Splits "<a> ::= body" lines into rules; alternatives are parsed once every
+// rule name is known
+Grammar read_grammar(std::istream &in) {
+    std::vector<std::pair<std::string, std::string>> rules{};
+    std::string line{};
+    while (std::getline(in, line)) {
+        line = trim(line);
+        if (line.empty()) {
+            continue;
+        }
+        auto arrow = line.find("::=");
+        if (line[0] != '<' || arrow == std::string::npos) {
+            throw std::runtime_error("Expected \"<rule> ::= ...\": " + line);
+        }
+        auto name = trim(line.substr(0, arrow));
+        rules.emplace_back(name.substr(1, name.size() - 2),
+                           trim(line.substr(arrow + 3)));
+    }
+
+    Grammar grammar{};
+    for (const auto &[name, body] : rules) {
+        if (body.front() == '?') {
+            grammar.token_classes.push_back(name);
+        } else {
+            grammar.nonterminals.push_back(name);
+        }
+    }
+
+    for (const auto &[name, body] : rules) {
+        if (body.front() == '?') {
+            continue;
+        }
+        Production production{grammar.index_of(name)};
+        bool empty = false;
+        auto finish = [&] {
+            if (production.rhs.empty() != empty) {
+                throw std::runtime_error(
+                    (empty ? "\"\" mixed with symbols in <"
+                           : "Empty alternative in <") +
+                    name + ">");
+            }
+            empty = false;
+            production.text = "<" + name + "> ::=" + production.text;
+            grammar.productions.push_back(production);
+            production = Production{grammar.index_of(name)};
+        };
+
+        for (std::size_t pos = 0; pos < body.size();) {
+            char ch = body[pos];
+            if (ch == ' ' || ch == '\t') {
+                pos++;
+            } else if (ch == '|') {
+                finish();
+                pos++;
+            } else if (ch == '"' || ch == '<') {
+                auto end = body.find(ch == '"' ? '"' : '>', pos + 1);
+                if (end == std::string::npos) {
+                    throw std::runtime_error("Unterminated symbol in <" +
+                                             name + ">");
+                }
+                auto inner = body.substr(pos + 1, end - pos - 1);
+                production.text += " " + body.substr(pos, end - pos + 1);
+                if (ch == '"' && inner.empty()) {
+                    empty = true;
+                } else if (ch == '"') {
+                    production.rhs.push_back(
+                        {true, "terminal(\"" + inner + "\")"});
+                } else if (std::find(grammar.token_classes.begin(),
+                                     grammar.token_classes.end(),
+                                     inner) != grammar.token_classes.end()) {
+                    production.rhs.push_back(
+                        {true, "token_class(\"" + inner + "\")"});
+                } else {
+                    grammar.index_of(inner);
+                    production.rhs.push_back({false, inner});
+                }
+                pos = end + 1;
+            } else {
+                throw std::runtime_error("Unexpected \"" + std::string(1, ch) +
+                                         "\" in <" + name + ">");
+            }
+        }
+        finish();
+    }
+    return grammar;
+}
+
+// Nonterminals that can derive the empty sequence
+std::vector<bool> nullable_set(const Grammar &grammar) {
+    std::vector<bool> nullable(grammar.nonterminals.size());
+    for (bool changed = true; changed;) {
+        changed = false;
+        for (const auto &production : grammar.productions) {
+            if (nullable[production.lhs]) {
+                continue;
+            }
+            auto all_nullable = std::all_of(
+                production.rhs.begin(), production.rhs.end(),
+                [&](const auto &symbol) {
+                    return !symbol.terminal &&
+                           nullable[grammar.index_of(symbol.name)];
+                });
+            if (all_nullable) {
+                nullable[production.lhs] = changed = true;
+            }
+        }
+    }
+    return nullable;
+}
+
+// Adds FIRST of the symbols in [begin, end) to `set`. Returns whether they
+// can all derive the empty sequence.
+template <typename Iterator>
+bool add_first(TerminalSet &set, Iterator begin, Iterator end,
+               const Grammar &grammar, const std::vector<TerminalSet> &first,
+               const std::vector<bool> &nullable, bool &changed) {
+    for (auto it = begin; it != end; ++it) {
+        if (it->terminal) {
+            changed |= insert(set, it->name);
+            return false;
+        }
+        auto index = grammar.index_of(it->name);
+        for (const auto &terminal : first[index]) {
+            changed |= insert(set, terminal);
+        }
+        if (!nullable[index]) {
+            return false;
+        }
+    }
+    return true;
+}
+
+std::vector<TerminalSet> first_sets(const Grammar &grammar,
+                                    const std::vector<bool> &nullable) {
+    std::vector<TerminalSet> first(grammar.nonterminals.size());
+    for (bool changed = true; changed;) {
+        changed = false;
+        for (const auto &production : grammar.productions) {
+            add_first(first[production.lhs], production.rhs.begin(),
+                      production.rhs.end(), grammar, first, nullable,
+                      changed);
+        }
+    }
+    return first;
+}
+
+std::vector<TerminalSet> follow_sets(const Grammar &grammar,
+                                     const std::vector<TerminalSet> &first,
+                                     const std::vector<bool> &nullable) {
+    std::vector<TerminalSet> follow(grammar.nonterminals.size());
+    insert(follow[0], "TokenKind::Eof");
+    for (bool changed = true; changed;) {
+        changed = false;
+        for (const auto &production : grammar.productions) {
+            const auto &rhs = production.rhs;
+            for (std::size_t i = 0; i < rhs.size(); i++) {
+                if (rhs[i].terminal) {
+                    continue;
+                }
+                auto target = grammar.index_of(rhs[i].name);
+                auto rest_nullable =
+                    add_first(follow[target], rhs.begin() + i + 1, rhs.end(),
+                              grammar, first, nullable, changed);
+                if (rest_nullable) {
+                    for (const auto &terminal : follow[production.lhs]) {
+                        changed |= insert(follow[target], terminal);
+                    }
+                }
+            }
+        }
+    }
+    return follow;
+}
+
+std::vector<std::string> production_names(const Grammar &grammar) {
+    std::vector<std::string> names{};
+    for (std::size_t i = 0; i < grammar.productions.size(); i++) {
+        auto lhs = grammar.productions[i].lhs;
+        auto alternatives = std::count_if(
+            grammar.productions.begin(), grammar.productions.end(),
+            [&](const auto &p) { return p.lhs == lhs; });
+        auto name = camel_case(grammar.nonterminals[lhs]);
+        if (alternatives > 1) {
+            auto index = std::count_if(
+                grammar.productions.begin(), grammar.productions.begin() + i,
+                [&](const auto &p) { return p.lhs == lhs; });
+            name += std::to_string(index);
+        }
+        names.push_back(name);
+    }
+    return names;
+}
+
+void write_sets(std::ostream &out, const Grammar &grammar,
+                const std::string &name,
+                const std::vector<TerminalSet> &sets) {
+    std::size_t total{0};
+    out << "constexpr std::array<std::uint8_t, " << sets.size() + 1 << "> "
+        << name << "_BEGIN{";
+    for (const auto &set : sets) {
+        out << total << ", ";
+        total += set.size();
+    }
+    out << total << "};\n";
+    out << "constexpr std::array<TokenKind, " << total << "> " << name
+        << "{{\n";
+    for (std::size_t i = 0; i < sets.size(); i++) {
+        out << "    // <" << grammar.nonterminals[i] << ">\n";
+        for (const auto &terminal : sets[i]) {
+            out << "    " << terminal << ",\n";
+        }
+    }
+    out << "}};\n\n";
+}
+
+void write_header(std::ostream &out, const Grammar &grammar) {
+    auto nullable = nullable_set(grammar);
+    auto first = first_sets(grammar, nullable);
+    auto follow = follow_sets(grammar, first, nullable);
+    auto names = production_names(grammar);
+
+    struct Entry {
+        std::size_t nonterminal;
+        std::string terminal;
+        std::size_t production;
+    };
+    std::vector<Entry> table{};
+    for (std::size_t p = 0; p < grammar.productions.size(); p++) {
+        const auto &production = grammar.productions[p];
+        TerminalSet predict{};
+        bool changed = false;
+        if (add_first(predict, production.rhs.begin(), production.rhs.end(),
+                      grammar, first, nullable, changed)) {
+            for (const auto &terminal : follow[production.lhs]) {
+                insert(predict, terminal);
+            }
+        }
+        for (const auto &terminal : predict) {
+            for (const auto &entry : table) {
+                if (entry.nonterminal == production.lhs &&
+                    entry.terminal == terminal) {
+                    throw std::runtime_error(
+                        "Grammar is not LL(1): " + production.text + " and " +
+                        grammar.productions[entry.production].text +
+                        " both start with " + terminal);
+                }
+            }
+            table.push_back({production.lhs, terminal, p});
+        }
+    }
+
+    out << "// Generated from grammar.ebnf by tools/llgen.cpp. Do not edit.\n"
+           "#pragma once\n\n"
+           "#include <array>\n#include <cstdint>\n\n"
+           "#include \"grammar.h\"\n\n"
+           "namespace Grammar {\n";
+
+    out << "enum class Nonterminal : std::uint8_t {\n";
+    for (const auto &nonterminal : grammar.nonterminals) {
+        out << "    " << camel_case(nonterminal) << ",\n";
+    }
+    out << "};\nconstexpr std::size_t NONTERMINAL_COUNT = "
+        << grammar.nonterminals.size() << ";\n\n";
+
+    out << "enum class Production : std::uint8_t {\n";
+    for (std::size_t p = 0; p < names.size(); p++) {
+        out << "    " << names[p] << ", // " << grammar.productions[p].text
+            << "\n";
+    }
+    out << "};\nconstexpr std::size_t PRODUCTION_COUNT = " << names.size()
+        << ";\n\n";
+
+    out << "constexpr std::array<Nonterminal, " << names.size()
+        << "> PRODUCTION_LHS{{\n";
+    for (const auto &production : grammar.productions) {
+        out << "    Nonterminal::"
+            << camel_case(grammar.nonterminals[production.lhs]) << ",\n";
+    }
+    out << "}};\n\n";
+
+    // Right-hand sides, back to back
+    std::size_t total{0};
+    out << "constexpr std::array<std::uint8_t, " << names.size() + 1
+        << "> RHS_BEGIN{";
+    for (const auto &production : grammar.productions) {
+        out << total << ", ";
+        total += production.rhs.size();
+    }
+    out << total << "};\n";
+    out << "constexpr std::array<Symbol, " << total << "> RHS{{\n";
+    for (const auto &production : grammar.productions) {
+        for (const auto &symbol : production.rhs) {
+            if (symbol.terminal) {
+                out << "    token(" << symbol.name << "),\n";
+            } else {
+                out << "    rule(Nonterminal::" << camel_case(symbol.name)
+                    << "),\n";
+            }
+        }
+    }
+    out << "}};\n\n";
+
+    out << "// Terminals that can start each nonterminal, and that can follow "
+           "it\n";
+    write_sets(out, grammar, "FIRST", first);
+    write_sets(out, grammar, "FOLLOW", follow);
+
+    out << "// Nonterminals that can match no tokens at all\n"
+           "constexpr std::array<bool, "
+        << nullable.size() << "> NULLABLE{";
+    for (std::size_t i = 0; i < nullable.size(); i++) {
+        out << (i ? ", " : "") << (nullable[i] ? "true" : "false");
+    }
+    out << "};\n\n";
+
+    out << "constexpr std::array<TableEntry<Nonterminal, Production>, "
+        << table.size() << "> TABLE_ENTRIES{{\n";
+    for (const auto &entry : table) {
+        out << "    {Nonterminal::"
+            << camel_case(grammar.nonterminals[entry.nonterminal]) << ", "
+            << entry.terminal << ", Production::" << names[entry.production]
+            << "},\n";
+    }
+    out << "}};\n";
+    out << "constexpr auto PARSE_TABLE =\n"
+           "    dense_table<NONTERMINAL_COUNT>(TABLE_ENTRIES);\n"
+           "} // namespace Grammar\n";
+}
+} // namespace
+
+int main(int argc, char *argv[]) {
+    if (argc != 3) {
+        std::cerr << "usage: llgen grammar.ebnf output.h\n";
+        return 2;
+    }
+    std::ifstream in(argv[1]);
+    if (!in) {
+        std::cerr << "llgen: cannot read " << argv[1] << "\n";
+        return 1;
+    }
+
+    std::ostringstream header{};
+    try {
+        write_header(header, read_grammar(in));
+    } catch (const std::runtime_error &error) {
+        std::cerr << argv[1] << ": error: " << error.what() << "\n";
+        return 1;
+    }
+
+    std::ofstream out(argv[2]);
+    out << header.str();
+    return out ? 0 : 1;
+}